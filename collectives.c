@@ -0,0 +1,373 @@
+#define _GNU_SOURCE // vmsplice(), F_SETPIPE_SZ
+#include "collectives.h"
+#include <limits.h>
+#include <sys/uio.h>
+
+
+/**
+ * Exchanges a block of bytes with the neighbour across one dimension.
+ * 
+ * Both neighbours call this function at the same time with the same length. Writes
+ * are limited to PIPE_BUF bytes and only issued when poll() reports the pipe as
+ * writable, so neither side can block in write() while the other one is blocked
+ * too: blocks larger than the pipe capacity are streamed in both directions at once.
+ * 
+ * param dim The dimension to exchange across; the neighbour is id ^ (1 << dim).
+ * param out The block sent to the neighbour.
+ * param in The buffer receiving the neighbour's block, len bytes long.
+ * param len The size of both blocks in bytes.
+ */
+void exchangeBlock(int dim, const void *out, void *in, size_t len)
+{
+    const char *src = out;
+    char *dst = in;
+    size_t sent = 0, received = 0;
+    struct pollfd fds[2];
+
+    fds[0].fd = connectedPipes[2*dim];     // read end of the edge from the neighbour
+    fds[1].fd = connectedPipes[2*dim + 1]; // write end of the edge to the neighbour
+
+    while (sent < len || received < len)
+    {
+        fds[0].events = received < len ? POLLIN : 0;
+        fds[1].events = sent < len ? POLLOUT : 0;
+
+        if (poll(fds, 2, -1) == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("poll");
+            exit(EXIT_FAILURE);
+        }
+
+        if (fds[1].revents & (POLLOUT | POLLERR))
+        {
+            size_t chunk = len - sent < PIPE_BUF ? len - sent : PIPE_BUF;
+            ssize_t w = write(fds[1].fd, src + sent, chunk);
+            if (w == -1)
+            {
+                perror("write failed");
+                exit(EXIT_FAILURE);
+            }
+            sent += w;
+        }
+
+        if (fds[0].revents & (POLLIN | POLLHUP))
+        {
+            ssize_t r = read(fds[0].fd, dst + received, len - received);
+            if (r <= 0)
+            {
+                perror("pipe read fail");
+                exit(EXIT_FAILURE);
+            }
+            received += r;
+        }
+    }
+}
+
+
+/**
+ * Sends a block of bytes to the neighbour across one dimension.
+ * 
+ * The neighbour must call receiveBlock() with the same length. The write blocks
+ * until the neighbour has drained what does not fit in the pipe.
+ * 
+ * param dim The dimension to send across.
+ * param out The block to send.
+ * param len The size of the block in bytes.
+ */
+void sendBlock(int dim, const void *out, size_t len)
+{
+    const char *src = out;
+    size_t sent = 0;
+
+    while (sent < len)
+    {
+        ssize_t w = write(connectedPipes[2*dim + 1], src + sent, len - sent);
+        if (w == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("write failed");
+            exit(EXIT_FAILURE);
+        }
+        sent += w;
+    }
+}
+
+
+/**
+ * Sends a block of bytes to the neighbour across one dimension without copying it.
+ * 
+ * vmsplice() hands the pages of the block to the pipe instead of copying them into the
+ * pipe buffer, so the only copy left is the read() of the neighbour. The pages stay
+ * referenced by the pipe until the neighbour has read them: the block must not change
+ * until then, which a sender that reuses an unchanged buffer satisfies. The neighbour
+ * must call receiveBlock() with the same length.
+ * 
+ * param dim The dimension to send across.
+ * param out The block to send, page aligned.
+ * param len The size of the block in bytes.
+ */
+void spliceBlock(int dim, const void *out, size_t len)
+{
+    struct iovec iov = { (void *)out, len };
+
+    while (iov.iov_len > 0)
+    {
+        ssize_t w = vmsplice(connectedPipes[2*dim + 1], &iov, 1, 0);
+        if (w == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("vmsplice");
+            exit(EXIT_FAILURE);
+        }
+        iov.iov_base = (char *)iov.iov_base + w;
+        iov.iov_len -= w;
+    }
+}
+
+
+/**
+ * Grows the pipe carrying the messages sent across one dimension, so that large blocks
+ * take fewer round trips between the sender and the receiver. The size is halved until
+ * the system accepts it, and the default is kept if it accepts none.
+ * 
+ * param dim The dimension of the edge to the neighbour.
+ * param size The wanted capacity in bytes.
+ */
+void growPipe(int dim, int size)
+{
+    while (size > 65536 && fcntl(connectedPipes[2*dim + 1], F_SETPIPE_SZ, size) == -1)
+        size /= 2;
+}
+
+
+/**
+ * Receives a block of bytes from the neighbour across one dimension.
+ * 
+ * param dim The dimension to receive from.
+ * param in The buffer receiving the block.
+ * param len The size of the block in bytes.
+ */
+void receiveBlock(int dim, void *in, size_t len)
+{
+    char *dst = in;
+    size_t received = 0;
+
+    while (received < len)
+    {
+        ssize_t r = read(connectedPipes[2*dim], dst + received, len - received);
+        if (r == -1 && errno == EINTR)
+            continue;
+        if (r <= 0)
+        {
+            perror("pipe read fail");
+            exit(EXIT_FAILURE);
+        }
+        received += r;
+    }
+}
+
+
+/**
+ * Synchronises all the nodes of the hypercube.
+ * 
+ * In round d the node sends a message to its neighbour across dimension d and waits
+ * for the neighbour's message. After round d a node has transitively heard from the
+ * 2^(d+1) nodes sharing its bits above d, so after n rounds no node can leave the
+ * barrier before every node has entered it.
+ * 
+ * Every message carries the barrier epoch, which catches nodes that call the barrier
+ * a different number of times. Messages are smaller than PIPE_BUF and at most one
+ * is pending per edge, so the write never blocks.
+ * 
+ * param id The ID of the current process.
+ * param n The dimension of the hypercube.
+ */
+void barrier(int id, int n)
+{
+    static int epoch = 0;
+    int received;
+
+    epoch++;
+    for (int d = 0; d < n; d++)
+    {
+        if (write(connectedPipes[2*d + 1], &epoch, sizeof(epoch)) != sizeof(epoch))
+        {
+            perror("write failed");
+            exit(EXIT_FAILURE);
+        }
+        if (read(connectedPipes[2*d], &received, sizeof(received)) != sizeof(received))
+        {
+            perror("pipe read fail");
+            exit(EXIT_FAILURE);
+        }
+        if (received != epoch)
+        {
+            fprintf(stderr, "node %d: barrier epoch %d received %d from dimension %d\n", id, epoch, received, d);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+
+/**
+ * All-to-all personalized exchange in n store-and-forward rounds.
+ * 
+ * Node id starts with 2^n blocks, block d being addressed to node d, and ends with
+ * the 2^n blocks addressed to it, block s coming from node s. In round d every node
+ * exchanges with its neighbour across dimension d the half of its buffer whose
+ * destination differs from it in bit d, so every link carries 2^(n-1) blocks per
+ * round in both directions.
+ * 
+ * Before round d, slot s of node id holds the block sent by (s & low) | (id & ~low)
+ * to (id & low) | (s & ~low), with low = (1 << d) - 1. The slots sent and received in
+ * a round are therefore the ones whose bit d differs from bit d of id, packed in
+ * increasing order on both sides.
+ * 
+ * param id The ID of the current process.
+ * param n The dimension of the hypercube.
+ * param send The 2^n outgoing blocks, indexed by destination.
+ * param recv The 2^n incoming blocks, indexed by source. May not alias send.
+ * param blockBytes The size of one block in bytes.
+ * param roundNs If not NULL, receives the time spent in each of the n rounds.
+ */
+void allToAll(int id, int n, const void *send, void *recv, size_t blockBytes, uint64_t *roundNs)
+{
+    int nodes = 1<<n;
+    size_t half = (nodes / 2) * blockBytes;
+    char *slots = recv;
+    char *out = malloc(half);
+    char *in = malloc(half);
+    if (out == NULL || in == NULL)
+    {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    memcpy(slots, send, nodes * blockBytes);
+
+    for (int d = 0; d < n; d++)
+    {
+        uint64_t start = monotonicNs();
+        int bit = id & (1 << d);
+        int k = 0;
+
+        for (int s = 0; s < nodes; s++)
+            if ((s & (1 << d)) != bit)
+                memcpy(out + blockBytes * k++, slots + blockBytes * s, blockBytes);
+
+        exchangeBlock(d, out, in, half);
+
+        k = 0;
+        for (int s = 0; s < nodes; s++)
+            if ((s & (1 << d)) != bit)
+                memcpy(slots + blockBytes * s, in + blockBytes * k++, blockBytes);
+
+        if (roundNs != NULL)
+            roundNs[d] = monotonicNs() - start;
+    }
+
+    free(out);
+    free(in);
+}
+
+
+/**
+ * Gathers one block from every node at the root.
+ * 
+ * The blocks travel up the binomial tree rooted at root: with r = id ^ root, in step
+ * d the nodes whose lowest set bit of r is d send everything they have collected so
+ * far (2^d blocks) to their neighbour across dimension d and leave. Each node
+ * aggregates its subtree before sending, so the gather takes n sequential steps.
+ * 
+ * param id The ID of the current process.
+ * param n The dimension of the hypercube.
+ * param root The node collecting the blocks.
+ * param block The block contributed by this node.
+ * param all At the root, receives the 2^n blocks indexed by source node. Other nodes
+ *            may pass NULL.
+ * param blockBytes The size of one block in bytes.
+ */
+void gather(int id, int n, int root, const void *block, void *all, size_t blockBytes)
+{
+    int nodes = 1<<n;
+    int r = id ^ root;
+    size_t held = r ? ((size_t)1 << __builtin_ctz(r)) : (size_t)nodes; // size of the subtree
+    char *buffer = malloc(held * blockBytes); // blocks of the subtree, by relative ID
+    if (buffer == NULL)
+    {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    memcpy(buffer, block, blockBytes);
+
+    for (int d = 0; d < n; d++)
+    {
+        size_t subtree = ((size_t)1 << d) * blockBytes;
+
+        if (r & (1 << d))
+        {
+            sendBlock(d, buffer, subtree);
+            free(buffer);
+            return;
+        }
+        receiveBlock(d, buffer + subtree, subtree);
+    }
+
+    // Only the root gets here, with the blocks ordered by ID relative to itself
+    for (int q = 0; q < nodes; q++)
+        memcpy((char *)all + (q ^ root) * blockBytes, buffer + q * blockBytes, blockBytes);
+
+    free(buffer);
+}
+
+
+/**
+ * Distributes a distinct block from the root to every node.
+ * 
+ * The reverse of gather(): with r = id ^ root, in step d (from n-1 down to 0) the
+ * nodes whose low d+1 bits of r are zero hold the 2^(d+1) blocks of their subtree and
+ * send the upper half to their neighbour across dimension d.
+ * 
+ * param id The ID of the current process.
+ * param n The dimension of the hypercube.
+ * param root The node holding the blocks.
+ * param all At the root, the 2^n blocks indexed by destination node. Other nodes may
+ *            pass NULL.
+ * param block Receives the block addressed to this node.
+ * param blockBytes The size of one block in bytes.
+ */
+void scatter(int id, int n, int root, const void *all, void *block, size_t blockBytes)
+{
+    int nodes = 1<<n;
+    int r = id ^ root;
+    size_t held = r ? ((size_t)1 << __builtin_ctz(r)) : (size_t)nodes; // size of the subtree
+    char *buffer = malloc(held * blockBytes); // blocks of the subtree, by relative ID
+    if (buffer == NULL)
+    {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    if (r == 0)
+        for (int q = 0; q < nodes; q++)
+            memcpy(buffer + q * blockBytes, (const char *)all + (q ^ root) * blockBytes, blockBytes);
+
+    for (int d = n - 1; d >= 0; d--)
+    {
+        int low = r & ((2 << d) - 1);
+        size_t subtree = ((size_t)1 << d) * blockBytes;
+
+        if (low == 0)
+            sendBlock(d, buffer + subtree, subtree);
+        else if (low == (1 << d))
+            receiveBlock(d, buffer, subtree);
+    }
+
+    memcpy(block, buffer, blockBytes);
+    free(buffer);
+}
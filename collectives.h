@@ -0,0 +1,24 @@
+#ifndef COLLECTIVES_H
+#define COLLECTIVES_H
+
+#include "hypercube.h"
+
+void exchangeBlock(int dim, const void *out, void *in, size_t len);
+
+void sendBlock(int dim, const void *out, size_t len);
+
+void spliceBlock(int dim, const void *out, size_t len);
+
+void growPipe(int dim, int size);
+
+void receiveBlock(int dim, void *in, size_t len);
+
+void barrier(int id, int n);
+
+void allToAll(int id, int n, const void *send, void *recv, size_t blockBytes, uint64_t *roundNs);
+
+void gather(int id, int n, int root, const void *block, void *all, size_t blockBytes);
+
+void scatter(int id, int n, int root, const void *all, void *block, size_t blockBytes);
+
+#endif //COLLECTIVES_H
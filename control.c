@@ -0,0 +1,473 @@
+#include "control.h"
+#include "fault.h"
+#include "mailbox.h"
+#include <sys/signalfd.h>
+#include <sys/stat.h>
+
+struct runControl *runControl;
+
+static int signalFd = -1;
+static int controlFd = -1;
+static char controlPath[128];
+static sigset_t previousMask;
+
+/**
+ * Command waiting for the children to acknowledge it.
+ */
+enum pending {
+    PENDING_NONE,
+    PENDING_PAUSE,  // acknowledged when every live child is stopped, or every token parked
+    PENDING_RESUME, // acknowledged when every live child is running again, or no token parked
+    PENDING_STOP    // acknowledged when every child has exited
+};
+
+
+/**
+ * Read the run clock in nanoseconds: the monotonic clock minus the time the cube spent
+ * paused. It stands still during a pause, so the same value is seen by every node.
+ * 
+ * The parent publishes the clock as the single word runClockBase, stored once on pause
+ * and once on resume, so a node never sees half of a transition.
+ * 
+ * return uint64_t The current run time in nanoseconds
+ */
+uint64_t runClockNs()
+{
+    uint64_t base = __atomic_load_n(&runControl->runClockBase, __ATOMIC_ACQUIRE);
+
+    if (base & RUN_CLOCK_FROZEN)
+        return base & ~RUN_CLOCK_FROZEN;
+    return monotonicNs() - base;
+}
+
+
+/**
+ * Prepares the control plane of the parent, before any child is forked.
+ * 
+ * The control signals are blocked and read from a signalfd instead of being handled
+ * asynchronously, so a signal received while the children are being forked is simply
+ * queued until controlLoop() runs. Commands can also be written, one per line, to the
+ * FIFO n/control:
+ * 
+ *   pause, resume, stop, stats, reconfigure key=value..., fault kill|stall node [ms]
+ * 
+ * SIGUSR1 toggles pause and resume, SIGUSR2 dumps the statistics, SIGINT and SIGTERM
+ * stop the run. The settings changed by reconfigure live in a shared page read by
+ * the nodes. The random generator of the parent, which picks the nodes of the faults and
+ * of the regenerations, is seeded here: the children seed their own after the fork.
+ * 
+ * n The dimension of the hypercube, used to name the control FIFO.
+ */
+void setupControl(int n)
+{
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGUSR1);
+    sigaddset(&mask, SIGUSR2);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGCHLD);
+
+    if (sigprocmask(SIG_BLOCK, &mask, &previousMask) == -1)
+    {
+        perror("sigprocmask");
+        exit(EXIT_FAILURE);
+    }
+
+    signalFd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (signalFd == -1)
+    {
+        perror("signalfd");
+        exit(EXIT_FAILURE);
+    }
+
+    srand(time(NULL) ^ getpid()); // The fault injection and the watchdog draw their nodes in the parent
+
+    char dirName[128];
+    sprintf(dirName, "%d", n);
+    mkdir(dirName, S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH);
+    snprintf(controlPath, sizeof(controlPath), "%d/control", n);
+
+    if (mkfifo(controlPath, S_IRUSR | S_IWUSR) == -1 && errno != EEXIST)
+    {
+        perror("mkfifo");
+        exit(EXIT_FAILURE);
+    }
+
+    // Opened for writing too, so the FIFO never reports end of file between two writers
+    controlFd = open(controlPath, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (controlFd == -1)
+    {
+        perror("open control fifo");
+        exit(EXIT_FAILURE);
+    }
+
+    runControl = mmap(NULL, sizeof(struct runControl), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (runControl == MAP_FAILED)
+    {
+        perror("mmap");
+        exit(EXIT_FAILURE);
+    }
+    runControl->verbose = 1;
+    runControl->logging = 1;
+}
+
+
+/**
+ * Drops the parent's control plane in a freshly forked child.
+ * 
+ * The child closes the signalfd and the FIFO and gets the signal mask the parent had
+ * before setupControl(), so it handles signals with their default action. SIGINT stays
+ * blocked: a Ctrl-C reaches the whole process group, and the parent turns it into a
+ * stop command so that the nodes shut down through the termination protocol.
+ */
+void detachControl()
+{
+    sigset_t mask = previousMask;
+    sigaddset(&mask, SIGINT);
+
+    close(signalFd);
+    close(controlFd);
+    sigprocmask(SIG_SETMASK, &mask, NULL);
+}
+
+
+/**
+ * Sends a signal to every child still running.
+ */
+static void signalChildren(int signum)
+{
+    for (int i = 0; i < nbProcesses; i++)
+    {
+        if (childs[i] > 0)
+        {
+            kill(childs[i], signum);
+        }
+    }
+}
+
+
+/**
+ * Prints the per-node token statistics kept in the shared page.
+ */
+static void dumpStats(int n)
+{
+    uint64_t hops = 0;
+
+    for (int i = 0; i < nbProcesses; i++)
+    {
+        char *binaryString = intToBinary(i, n);
+        printf("node %s: hops %llu, last token %d\n", binaryString, (unsigned long long)nodeStats[i].items, nodeStats[i].token);
+        free(binaryString);
+        hops += nodeStats[i].items;
+    }
+    printf("control: stats of %d nodes, %llu hops\n", nbProcesses, (unsigned long long)hops);
+}
+
+
+/**
+ * Applies the key=value pairs of a reconfigure command to the shared settings.
+ */
+static void reconfigure(char *arguments)
+{
+    for (char *pair = strtok(arguments, " \t"); pair != NULL; pair = strtok(NULL, " \t"))
+    {
+        char *value = strchr(pair, '=');
+        if (value == NULL)
+        {
+            printf("control: ignoring '%s', expected key=value\n", pair);
+            continue;
+        }
+        *value++ = '\0';
+
+        if (strcmp(pair, "verbose") == 0)
+            runControl->verbose = atoi(value);
+        else if (strcmp(pair, "logging") == 0)
+            runControl->logging = atoi(value);
+        else
+            printf("control: unknown setting '%s'\n", pair);
+    }
+}
+
+
+/**
+ * Runs one command and returns the acknowledgement it now waits for.
+ */
+static enum pending runCommand(char *line, int n, int *paused)
+{
+    char *arguments = line + strcspn(line, " \t");
+    if (*arguments != '\0')
+        *arguments++ = '\0';
+
+    if (strcmp(line, "pause") == 0 && !*paused)
+    {
+        if (opts.workload == WORKLOAD_TOKEN)
+        {
+            runControl->pauseStartNs = monotonicNs();
+            __atomic_store_n(&runControl->runClockBase, RUN_CLOCK_FROZEN | (runControl->pauseStartNs - runControl->pausedTotalNs), __ATOMIC_RELEASE);
+            __atomic_store_n(&runControl->pauseRequested, 1, __ATOMIC_RELEASE);
+        }
+        else
+            signalChildren(SIGSTOP);
+        *paused = 1;
+        return PENDING_PAUSE;
+    }
+    if (strcmp(line, "resume") == 0 && *paused)
+    {
+        if (opts.workload == WORKLOAD_TOKEN)
+        {
+            uint64_t pause = monotonicNs() - runControl->pauseStartNs;
+            runControl->pausedTotalNs += pause;
+            __atomic_store_n(&runControl->runClockBase, runControl->pausedTotalNs, __ATOMIC_RELEASE);
+            __atomic_store_n(&runControl->pauseRequested, 0, __ATOMIC_RELEASE);
+            printf("control: cube was paused for %.3f ms\n", pause / 1e6);
+        }
+        else
+            signalChildren(SIGCONT);
+        *paused = 0;
+        return PENDING_RESUME;
+    }
+    if (strcmp(line, "stop") == 0)
+    {
+        if (*paused && opts.workload != WORKLOAD_TOKEN)
+        {
+            signalChildren(SIGCONT);
+            *paused = 0;
+        }
+        if (opts.workload == WORKLOAD_TOKEN)
+        {
+            runControl->stopRequested = 1; // the nodes shut down at their next hop or wake-up
+            signalChildren(SIGUSR2);
+        }
+        else
+            signalChildren(SIGTERM);
+        return PENDING_STOP;
+    }
+    if (strcmp(line, "stats") == 0)
+    {
+        dumpStats(n);
+        return PENDING_NONE;
+    }
+    if (strcmp(line, "reconfigure") == 0)
+    {
+        reconfigure(arguments);
+        return PENDING_NONE;
+    }
+    if (strcmp(line, "fault") == 0)
+    {
+        char kind[16] = "", target[32] = "";
+        int ms = 0;
+        sscanf(arguments, "%15s %31s %d", kind, target, &ms);
+        int node = strcmp(target, "random") == 0 ? RANDOM_NODE : atoi(target);
+
+        if (strcmp(kind, "kill") == 0)
+            injectFault(FAULT_KILL, node, 0, n);
+        else if (strcmp(kind, "stall") == 0)
+            injectFault(FAULT_STALL, node, (uint64_t)ms * 1000000, n);
+        else
+            printf("control: usage: fault kill|stall <node|random> [ms]\n");
+        return PENDING_NONE;
+    }
+    if (strcmp(line, "pause") != 0 && strcmp(line, "resume") != 0)
+        printf("control: unknown command '%s'\n", line);
+    return PENDING_NONE;
+}
+
+
+/**
+ * Waits for the children while serving control commands, until every child has exited.
+ * 
+ * This replaces waitChild() in the parent: one poll() covers the signalfd and the
+ * control FIFO, and children are reaped on SIGCHLD with waitpid(WNOHANG), which also
+ * reports them stopping and continuing. A command is therefore handled synchronously
+ * and its latency is printed once the children have acknowledged it: the time to send
+ * it to every child (fan-out) and the time until they all reached the requested state.
+ * For the token workload, pause and resume go through the shared page instead of
+ * SIGSTOP and SIGCONT; their acknowledgement is the count of parked tokens, polled
+ * every millisecond while the command is pending, against the tokens still walking
+ * (see walkingTokens()). A stop, and the end of --duration, also interrupt the waits of
+ * the nodes with SIGUSR2, so that they shut down even if no token is moving. The loop
+ * also wakes up to inject the faults scheduled with --fault and to run the --watchdog
+ * checks.
+ * 
+ * n The dimension of the hypercube.
+ */
+void controlLoop(int n)
+{
+    int alive = nbProcesses, stopped = 0, paused = 0;
+    int deadlineSignalled = 0; // 1 once the nodes were woken up at the end of --duration
+    enum pending pending = PENDING_NONE;
+    const char *pendingName = NULL;
+    uint64_t issuedNs = 0, fanOutNs = 0;
+    char buffer[4096];
+    size_t used = 0;
+
+    while (alive > 0)
+    {
+        struct pollfd fds[2] = {
+            { signalFd, POLLIN, 0 },
+            { controlFd, POLLIN, 0 }
+        };
+
+        int timeout = runDueFaults(n);
+        int check = watchdog(n);
+        if (check != -1 && (timeout == -1 || check < timeout))
+            timeout = check;
+        if ((pending == PENDING_PAUSE || pending == PENDING_RESUME) && (timeout == -1 || timeout > 1))
+            timeout = 1;
+        if (pending == PENDING_STOP && opts.workload == WORKLOAD_TOKEN)
+        {
+            // A node may have checked stopRequested just before it started waiting
+            signalChildren(SIGUSR2);
+            if (timeout == -1 || timeout > 10)
+                timeout = 10;
+        }
+        if (opts.duration && opts.workload == WORKLOAD_TOKEN && !deadlineSignalled)
+        {
+            uint64_t elapsed = runClockNs() - runControl->startNs;
+            if (elapsed >= opts.duration)
+            {
+                signalChildren(SIGUSR2); // The nodes shut down when they wake up, tokens or not
+                deadlineSignalled = 1;
+            }
+            else if (timeout == -1 || (uint64_t)timeout > (opts.duration - elapsed + 999999) / 1000000)
+                timeout = (opts.duration - elapsed + 999999) / 1000000;
+        }
+
+        if (poll(fds, 2, timeout) == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("poll");
+            exit(EXIT_FAILURE);
+        }
+
+        char *commands[16];
+        int nbCommands = 0;
+        int signals[16]; // commands[c] for c < nbSignals comes from signals[c]
+        int nbSignals = 0;
+        char signalCommand[16];
+
+        if (fds[0].revents & POLLIN)
+        {
+            struct signalfd_siginfo info;
+            while (read(signalFd, &info, sizeof(info)) == sizeof(info))
+            {
+                if (info.ssi_signo == SIGCHLD)
+                {
+                    int state;
+                    pid_t pid;
+                    while ((pid = waitpid(-1, &state, WNOHANG | WUNTRACED | WCONTINUED)) > 0)
+                    {
+                        if (WIFEXITED(state) || WIFSIGNALED(state))
+                        {
+                            for (int i = 0; i < nbProcesses; i++)
+                            {
+                                if (childs[i] != pid)
+                                    continue;
+                                childs[i] = 0;
+                                if (opts.transport != EDGES_PIPE)
+                                    mailboxExited(i, n); // What a closed pipe tells the neighbours
+                            }
+                            alive--;
+                        }
+                        else if (WIFSTOPPED(state))
+                            stopped++;
+                        else if (WIFCONTINUED(state) && stopped > 0)
+                            stopped--;
+                    }
+                }
+                else if (nbSignals < 16)
+                    signals[nbSignals++] = info.ssi_signo;
+                else
+                    printf("control: too many signals at once, %s dropped\n", strsignal(info.ssi_signo));
+            }
+        }
+
+        if (fds[1].revents & POLLIN)
+        {
+            ssize_t r = read(controlFd, buffer + used, sizeof(buffer) - 1 - used);
+            if (r > 0)
+                used += r;
+            if (used == sizeof(buffer) - 1 && memchr(buffer, '\n', used) == NULL)
+                used = 0; // a line longer than the buffer cannot be a command
+        }
+
+        nbCommands = nbSignals;
+        char *line = buffer;
+        char *end;
+        while (nbCommands < 16 && (end = memchr(line, '\n', used - (line - buffer))) != NULL)
+        {
+            *end = '\0';
+            if (end > line && end[-1] == '\r')
+                end[-1] = '\0';
+            if (*line != '\0')
+                commands[nbCommands++] = line;
+            line = end + 1;
+        }
+
+        for (int c = 0; c < nbCommands; c++)
+        {
+            if (c < nbSignals)
+            {
+                // Signals map to the equivalent FIFO command, SIGUSR1 toggling the pause in order
+                if (signals[c] == SIGUSR1)
+                    strcpy(signalCommand, paused ? "resume" : "pause");
+                else if (signals[c] == SIGUSR2)
+                    strcpy(signalCommand, "stats");
+                else
+                    strcpy(signalCommand, "stop");
+                commands[c] = signalCommand;
+            }
+
+            uint64_t received = monotonicNs();
+            const char *name = commands[c];
+            enum pending next = runCommand(commands[c], n, &paused);
+            uint64_t sent = monotonicNs();
+
+            if (next == PENDING_NONE)
+            {
+                printf("control: %s handled in %.1f us\n", name, (sent - received) / 1e3);
+            }
+            else
+            {
+                pending = next;
+                pendingName = next == PENDING_PAUSE ? "pause" : next == PENDING_RESUME ? "resume" : "stop";
+                issuedNs = received;
+                fanOutNs = sent - received;
+            }
+        }
+
+        // Keep the part of an incomplete line for the next read
+        used -= line - buffer;
+        memmove(buffer, line, used);
+
+        int parkedTokens = __atomic_load_n(&runControl->parkedTokens, __ATOMIC_SEQ_CST);
+        int quiesced = opts.workload == WORKLOAD_TOKEN ? parkedTokens >= walkingTokens() : stopped >= alive;
+        int running = opts.workload == WORKLOAD_TOKEN ? parkedTokens == 0 : stopped == 0;
+
+        if ((pending == PENDING_PAUSE && quiesced) ||
+            (pending == PENDING_RESUME && running) ||
+            (pending == PENDING_STOP && alive == 0))
+        {
+            printf("control: %s fanned out in %.1f us, acknowledged by all nodes in %.1f us\n",
+                   pendingName, fanOutNs / 1e3, (monotonicNs() - issuedNs) / 1e3);
+            pending = PENDING_NONE;
+        }
+    }
+    watchdog(n); // Closes a stall the end of the run interrupted
+}
+
+
+/**
+ * Releases the control plane once every child has exited.
+ */
+void closeControl()
+{
+    close(signalFd);
+    close(controlFd);
+    unlink(controlPath);
+    munmap(runControl, sizeof(struct runControl));
+    runControl = NULL;
+    sigprocmask(SIG_SETMASK, &previousMask, NULL);
+}
@@ -0,0 +1,46 @@
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include "hypercube.h"
+
+/**
+ * Settings shared with every node, written by the parent when it handles a
+ * reconfigure command and read by the nodes at each hop.
+ */
+#define RUN_CLOCK_FROZEN (1ULL << 63) // runClockBase holds the run time at which the pause froze the clock
+
+struct runControl {
+    volatile int verbose; // 1 to print every hop on the standard output
+    volatile int logging; // 1 to write every hop in the node file
+    volatile int stopRequested; // set by the stop command, the token walk then shuts down
+    volatile int pauseRequested; // set by the pause command, nodes park the tokens they receive
+    int parkedTokens;     // tokens currently parked by the nodes, updated atomically
+    uint64_t pauseStartNs;  // monotonic time at which the current pause started
+    volatile uint64_t pausedTotalNs; // time spent in the pauses that are over
+    uint64_t runClockBase; // monotonic minus run time while running, RUN_CLOCK_FROZEN | run time while paused
+    int faults;           // faults injected by the parent
+    volatile int regenerateNode;   // node asked by the watchdog to inject the tokens flagged in tokenStates
+    int regenerateTokens; // how many there are, taken atomically by regenerateNode
+    uint64_t regeneratedNs; // run clock at which the last regenerated tokens were injected
+    int stalls;           // stalls detected by the watchdog
+    int regenerated;      // tokens regenerated by the watchdog
+    uint64_t stalledNs;   // run time between the last hop before each stall and the first after it
+    uint64_t stalledUntilNs; // run clock at which the last stall ended, possibly after the last hop
+    int retiredTokens;    // tokens that made their --hops hops, updated atomically
+    uint64_t startNs;     // monotonic time at which the run started, for --duration
+    uint64_t shutdownNs;  // monotonic time at which the first node started the shutdown
+};
+
+extern struct runControl *runControl;
+
+uint64_t runClockNs();
+
+void setupControl(int n);
+
+void detachControl();
+
+void controlLoop(int n);
+
+void closeControl();
+
+#endif //CONTROL_H
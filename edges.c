@@ -0,0 +1,202 @@
+#define _GNU_SOURCE // syscall(), close_range()
+#include "edges.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+
+/**
+ * Maps memory shared with the processes forked afterwards.
+ *
+ * param size The size of the mapping.
+ * return The mapping, NULL on failure.
+ */
+void *mapShared(size_t size)
+{
+    void *memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    return memory == MAP_FAILED ? NULL : memory;
+}
+
+
+/**
+ * Appends a message to a ring. Only the sender of the edge calls it.
+ *
+ * return 0, or -1 if the ring is full.
+ */
+int ringPush(struct ring *ring, const struct message *message)
+{
+    uint32_t tail = ring->tail;
+
+    if (tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == RING_SLOTS)
+        return -1;
+    ring->slots[tail & (RING_SLOTS - 1)] = *message;
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+
+/**
+ * Takes the oldest message out of a ring. Only the receiver of the edge calls it.
+ *
+ * return 0, or -1 if the ring is empty.
+ */
+int ringPop(struct ring *ring, struct message *message)
+{
+    uint32_t head = ring->head;
+
+    if (head == __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE))
+        return -1;
+    *message = ring->slots[head & (RING_SLOTS - 1)];
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+
+/**
+ * return 1 if the ring holds a message.
+ */
+int ringPending(struct ring *ring)
+{
+    return ring->head != __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+}
+
+
+/**
+ * Wakes a node up if it sleeps on its doorbell, after a message was pushed to one of its
+ * rings.
+ *
+ * An eventfd doorbell is written for every message: it counts them until the node reads
+ * it, so a message sent after the node found its rings empty cannot be missed.
+ *
+ * A futex doorbell is only rung when the node sleeps. The node sets sleeping before it
+ * reads the futex word and checks its rings for the last time, and the sender bumps the
+ * word before it reads sleeping. Either the sender sees sleeping set and wakes the node,
+ * or the node sees the new message, or the word changed under FUTEX_WAIT, which then
+ * returns at once.
+ *
+ * doorbell The futex doorbell of the node.
+ * eventFd The eventfd doorbell of the node, -1 to use the futex one.
+ * return 1 if a system call was made to wake the node.
+ */
+int ringDoorbell(struct doorbell *doorbell, int eventFd)
+{
+    if (eventFd != -1)
+    {
+        uint64_t one = 1;
+        if (write(eventFd, &one, sizeof(one)) == -1)
+        {
+            perror("write failed");
+            exit(EXIT_FAILURE);
+        }
+        return 1;
+    }
+
+    __atomic_add_fetch(&doorbell->rings, 1, __ATOMIC_SEQ_CST);
+    if (!__atomic_load_n(&doorbell->sleeping, __ATOMIC_SEQ_CST))
+        return 0;
+    syscall(SYS_futex, &doorbell->rings, FUTEX_WAKE, 1, NULL, NULL, 0);
+    return 1;
+}
+
+
+/**
+ * Sleeps on the doorbell of a node until a message may have arrived, the select() of
+ * the rings. Returns at once if pending() finds something to read. An eventfd doorbell
+ * is read through poll() when the wait has a timeout; a futex doorbell follows the
+ * protocol of ringDoorbell().
+ *
+ * doorbell The futex doorbell of the node.
+ * eventFd The eventfd doorbell of the node, -1 to use the futex one.
+ * pending Returns 1 when the node has something to read, called with context.
+ * context Passed to pending().
+ * timeoutMs Longest wait in milliseconds, -1 for none.
+ * return 1 if the node went to sleep in the kernel, 0 if it did not, -1 with errno set
+ *        to EINTR when a signal interrupted the wait. A timeout or a spurious wake-up
+ *        also returns, the caller checks its rings again.
+ */
+int waitDoorbell(struct doorbell *doorbell, int eventFd, int (*pending)(void *context), void *context, int timeoutMs)
+{
+    if (pending(context))
+        return 0;
+
+    if (eventFd != -1)
+    {
+        struct pollfd bell = { eventFd, POLLIN, 0 };
+        uint64_t count;
+
+        ssize_t r = timeoutMs >= 0 ? poll(&bell, 1, timeoutMs) : 1;
+        if (r == 1)
+            r = read(eventFd, &count, sizeof(count));
+        if (r == -1 && errno != EINTR)
+        {
+            perror("doorbell");
+            exit(EXIT_FAILURE);
+        }
+        return r == -1 ? -1 : 1;
+    }
+
+    struct timespec timeout = { timeoutMs / 1000, (timeoutMs % 1000) * 1000000L };
+    long r = 0;
+    int error = 0, slept = 0;
+
+    __atomic_store_n(&doorbell->sleeping, 1, __ATOMIC_SEQ_CST);
+    uint32_t rings = __atomic_load_n(&doorbell->rings, __ATOMIC_SEQ_CST);
+    if (!pending(context))
+    {
+        slept = 1;
+        r = syscall(SYS_futex, &doorbell->rings, FUTEX_WAIT, rings, timeoutMs >= 0 ? &timeout : NULL, NULL, 0);
+        error = errno;
+    }
+    __atomic_store_n(&doorbell->sleeping, 0, __ATOMIC_RELAXED);
+
+    if (r == -1 && error == EINTR)
+    {
+        errno = EINTR;
+        return -1;
+    }
+    return slept; // EAGAIN: a message came before the node slept, ETIMEDOUT: the caller polls
+}
+
+
+/**
+ * Keeps the given descriptors of a forked node and closes all the others in O(count)
+ * system calls, whatever the size of the cube. The kept ones are duplicated above every
+ * descriptor of the cube, everything below is closed with one close_range(), and they are
+ * moved down to descriptors 3 to count + 2. Besides not depending on 2^n, this keeps the
+ * descriptors watched by select() below FD_SETSIZE whatever the dimension.
+ *
+ * kept The descriptors to keep, updated to their new numbers.
+ * count How many descriptors are kept.
+ * above A descriptor number higher than every descriptor of the cube.
+ */
+void keepDescriptors(int **kept, int count, int above)
+{
+    for (int j = 0; j < count; j++)
+    {
+        *kept[j] = fcntl(*kept[j], F_DUPFD, above);
+        if (*kept[j] == -1)
+        {
+            perror("fcntl");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    close_range(3, above - 1, 0);
+    for (int j = 0; j < count; j++)
+    {
+        if (dup2(*kept[j], 3 + j) == -1)
+        {
+            perror("dup2");
+            exit(EXIT_FAILURE);
+        }
+        *kept[j] = 3 + j;
+    }
+    close_range(3 + count, ~0U, 0);
+}
@@ -0,0 +1,55 @@
+#ifndef EDGES_H
+#define EDGES_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define RING_SLOTS 1024 // messages a ring holds, a power of two
+
+/**
+ * A message sent along an edge: the token and the time at which it was sent,
+ * so the receiver can measure the hop latency.
+ */
+struct message {
+    int token;       // the token, or TOKEN_STOP
+    uint64_t sentNs; // monotonic time at which the message was sent
+};
+
+/**
+ * A single-producer single-consumer ring of messages in shared memory, one per directed
+ * edge: ring node * n + dim holds the messages sent to node across dim, like the pipes.
+ * The head and the tail are on their own cache lines, written by the receiver and the
+ * sender respectively.
+ */
+struct ring {
+    volatile uint32_t head __attribute__((aligned(64))); // next slot to read
+    volatile uint32_t tail __attribute__((aligned(64))); // next slot to write
+    struct message slots[RING_SLOTS] __attribute__((aligned(64)));
+};
+
+/**
+ * What a node sleeps on while its rings are empty, with a futex doorbell. One cache line
+ * per node. With an eventfd doorbell the node sleeps on the eventfd instead, and only
+ * exited is used.
+ */
+struct doorbell {
+    uint32_t rings;    // futex word, bumped after every message sent to the node
+    uint32_t sleeping; // 1 while the node is in, or about to enter, FUTEX_WAIT
+    uint32_t exited;   // set by the parent of the cube once the node has been reaped
+} __attribute__((aligned(64)));
+
+void *mapShared(size_t size);
+
+int ringPush(struct ring *ring, const struct message *message);
+
+int ringPop(struct ring *ring, struct message *message);
+
+int ringPending(struct ring *ring);
+
+int ringDoorbell(struct doorbell *doorbell, int eventFd);
+
+int waitDoorbell(struct doorbell *doorbell, int eventFd, int (*pending)(void *context), void *context, int timeoutMs);
+
+void keepDescriptors(int **kept, int count, int above);
+
+#endif //EDGES_H
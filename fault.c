@@ -0,0 +1,296 @@
+#include "fault.h"
+#include "control.h"
+
+static struct fault faults[MAX_FAULTS * 2]; // room for the end of each stall
+static int nbFaults = 0;
+
+
+/**
+ * Schedules a fault given on the command line.
+ * 
+ * The format is kind:node@seconds, with kind kill or stall, node a node ID or random,
+ * and seconds the run time at which the fault is injected. A stall lasts for the time
+ * given after a +, e.g. stall:random@0.5+0.2.
+ * 
+ * param spec The fault description.
+ * return 0 on success, -1 if the description cannot be parsed.
+ */
+int addFault(const char *spec)
+{
+    struct fault fault = {0};
+    char target[32];
+    double at = 0, duration = 0;
+
+    if (nbFaults == MAX_FAULTS)
+        return -1;
+
+    if (strncmp(spec, "kill:", 5) == 0)
+    {
+        fault.kind = FAULT_KILL;
+        if (sscanf(spec + 5, "%31[^@]@%lf", target, &at) != 2)
+            return -1;
+    }
+    else if (strncmp(spec, "stall:", 6) == 0)
+    {
+        fault.kind = FAULT_STALL;
+        if (sscanf(spec + 6, "%31[^@]@%lf+%lf", target, &at, &duration) != 3)
+            return -1;
+    }
+    else
+        return -1;
+
+    fault.node = strcmp(target, "random") == 0 ? RANDOM_NODE : atoi(target);
+    fault.atNs = (uint64_t)(at * 1e9);
+    fault.forNs = (uint64_t)(duration * 1e9);
+    faults[nbFaults++] = fault;
+    return 0;
+}
+
+
+/**
+ * Injects a fault now.
+ * 
+ * A random target is drawn among the nodes still running. A stall schedules its own
+ * end forNs later on the run clock.
+ * 
+ * param kind The kind of fault.
+ * param node The target node, or RANDOM_NODE.
+ * param forNs The duration of a stall.
+ * param n The dimension of the hypercube.
+ */
+void injectFault(enum faultKind kind, int node, uint64_t forNs, int n)
+{
+    if (node == RANDOM_NODE)
+    {
+        int live = 0;
+        for (int i = 0; i < nbProcesses; i++)
+            if (childs[i] > 0)
+                live++;
+        if (live == 0)
+            return;
+
+        int k = rand() % live;
+        for (node = 0; childs[node] <= 0 || k-- > 0; node++)
+            ;
+    }
+
+    if (node < 0 || node >= nbProcesses || childs[node] <= 0)
+    {
+        printf("fault: node %d is not running\n", node);
+        return;
+    }
+
+    char *binaryString = intToBinary(node, n);
+    double at = (runClockNs() - runControl->startNs) / 1e9;
+
+    switch (kind)
+    {
+    case FAULT_KILL:
+        kill(childs[node], SIGKILL);
+        printf("fault: killed node %s at %.3f s\n", binaryString, at);
+        break;
+    case FAULT_STALL:
+        kill(childs[node], SIGSTOP);
+        printf("fault: stalled node %s at %.3f s for %.3f s\n", binaryString, at, forNs / 1e9);
+        if (nbFaults < MAX_FAULTS * 2)
+            faults[nbFaults++] = (struct fault){ FAULT_RESUME, node, runClockNs() - runControl->startNs + forNs, 0, 0 };
+        break;
+    case FAULT_RESUME:
+        kill(childs[node], SIGCONT);
+        printf("fault: resumed node %s at %.3f s\n", binaryString, at);
+        break;
+    }
+
+    if (kind != FAULT_RESUME)
+        runControl->faults++;
+    free(binaryString);
+}
+
+
+/**
+ * Injects the scheduled faults that are due.
+ * 
+ * Called by the parent's control loop, which sleeps at most until the next fault.
+ * 
+ * param n The dimension of the hypercube.
+ * return The time in milliseconds until the next fault, -1 if none is left.
+ */
+int runDueFaults(int n)
+{
+    int next = -1;
+
+    for (int f = 0; f < nbFaults; f++)
+    {
+        if (!faults[f].done && faults[f].atNs <= runClockNs() - runControl->startNs)
+        {
+            faults[f].done = 1;
+            injectFault(faults[f].kind, faults[f].node, faults[f].forNs, n);
+        }
+    }
+
+    // Measured after injecting, a stall above may have scheduled its end
+    uint64_t now = runClockNs() - runControl->startNs;
+    for (int f = 0; f < nbFaults; f++)
+    {
+        if (faults[f].done)
+            continue;
+        int wait = faults[f].atNs <= now ? 0 : (int)((faults[f].atNs - now + 999999) / 1000000);
+        if (next == -1 || wait < next)
+            next = wait;
+    }
+
+    return next;
+}
+
+
+/**
+ * return 1 if a stall fault holds the node stopped, i.e. its end is still scheduled.
+ */
+static int stalledNode(int node)
+{
+    for (int f = 0; f < nbFaults; f++)
+        if (faults[f].kind == FAULT_RESUME && faults[f].node == node && !faults[f].done)
+            return 1;
+    return 0;
+}
+
+
+/**
+ * return 1 if a token is gone: held by, or sent to, a node that has exited, or left
+ * without any live neighbour to go to.
+ */
+static int tokenGone(int t)
+{
+    int holder = tokenStates[t].holder;
+    return holder == HOLDER_LOST || (holder >= 0 && childs[holder] <= 0);
+}
+
+
+/**
+ * Counts the tokens still walking, i.e. neither retired, dropped nor gone.
+ *
+ * return The tokens held by, or on their way to, a live or stalled node.
+ */
+int walkingTokens()
+{
+    int walking = 0;
+
+    for (int t = 0; t < opts.tokens; t++)
+        if (tokenStates[t].holder >= 0 && !tokenGone(t))
+            walking++;
+    return walking;
+}
+
+
+/**
+ * Detects a stalled token walk and regenerates the lost tokens.
+ * 
+ * The walk is stalled when no node has made a hop for --watchdog, on the run clock. The
+ * tokens then regenerated are the ones gone with a dead node, as told by their holder in
+ * tokenStates: a token held by a stalled node is not lost and walks again when the node
+ * resumes. The watchdog asks a random live node that is not stalled, through the control
+ * page and SIGUSR2, to inject them again, each from its own last hop count, below --hops.
+ * The stall lasts from the last hop before it to the injection, or to the end of the run
+ * if the walk does not move again, and this run time is added to stalledNs as it goes.
+ * Called once more after the last child has exited, to close a stall the end of the run
+ * interrupted.
+ * 
+ * param n The dimension of the hypercube.
+ * return The time in milliseconds until the next check, -1 if the watchdog is off.
+ */
+int watchdog(int n)
+{
+    static uint64_t stallFromNs = 0; // last hop before the current stall, 0 while the walk moves
+    static uint64_t countedToNs = 0; // end of the part of the current stall already in stalledNs
+    int timeoutMs = (int)((opts.watchdog + 999999) / 1000000);
+
+    if (opts.watchdog == 0 || opts.workload != WORKLOAD_TOKEN)
+        return -1;
+
+    uint64_t last = runControl->startNs;
+    for (int i = 0; i < nbProcesses; i++)
+        if (nodeStats[i].lastHopNs > last)
+            last = nodeStats[i].lastHopNs;
+
+    uint64_t now = runClockNs();
+    int ending = runControl->shutdownNs != 0 || runControl->stopRequested;
+    if (stallFromNs != 0 && (last > stallFromNs || ending))
+    {
+        // The walk moves again from the regeneration, or from a hop seen since the last check,
+        // or the run ends while it is stalled
+        uint64_t end = last <= stallFromNs ? now : runControl->regeneratedNs > stallFromNs ? runControl->regeneratedNs : last;
+        if (end > countedToNs)
+            runControl->stalledNs += end - countedToNs;
+        runControl->stalledUntilNs = end;
+        printf("watchdog: walk %s after %.3f ms\n", last > stallFromNs ? "resumed" : "ended stalled", (end - stallFromNs) / 1e6);
+        stallFromNs = 0;
+    }
+    if (ending)
+        return -1;
+
+    if (__atomic_load_n(&runControl->pauseRequested, __ATOMIC_ACQUIRE))
+        return timeoutMs; // parked tokens do not hop
+    if (now - last < opts.watchdog)
+        return (int)((last + opts.watchdog - now + 999999) / 1000000);
+
+    if (stallFromNs == 0)
+    {
+        stallFromNs = countedToNs = last;
+        runControl->stalls++;
+    }
+
+    int node = runControl->regenerateNode;
+    if (__atomic_load_n(&runControl->regenerateTokens, __ATOMIC_ACQUIRE) > 0 && childs[node] > 0)
+    {
+        kill(childs[node], SIGUSR2); // The node has not taken the tokens yet
+        return timeoutMs;
+    }
+
+    int gone = 0;
+    for (int t = 0; t < opts.tokens; t++)
+        gone += tokenGone(t);
+    if (gone == 0)
+        return timeoutMs; // The tokens wait in stalled nodes
+
+    int live = 0;
+    for (int i = 0; i < nbProcesses; i++)
+        if (childs[i] > 0 && !stalledNode(i))
+            live++;
+    if (live == 0)
+        return timeoutMs;
+
+    int k = rand() % live;
+    for (node = 0; childs[node] <= 0 || stalledNode(node) || k-- > 0; node++)
+        ;
+
+    // No node takes tokens while they are handed over, the count is published last
+    __atomic_store_n(&runControl->regenerateTokens, 0, __ATOMIC_SEQ_CST);
+    for (int t = 0; t < opts.tokens; t++)
+    {
+        if (!tokenGone(t))
+            continue;
+        if (opts.hops && (uint64_t)tokenStates[t].hops >= opts.hops)
+            tokenStates[t].hops = opts.hops - 1; // Lost on its last hop, retired by the next node
+        if (!tokenStates[t].regenerate)
+            runControl->regenerated++; // Tokens left for a node that died before taking them are moved, not added
+        tokenStates[t].regenerate = 1;
+        tokenStates[t].holder = node;
+    }
+
+    char *binaryString = intToBinary(node, n);
+    printf("watchdog: no hop for %.3f ms, regenerating %d token(s) at node %s\n",
+           (now - last) / 1e6, gone, binaryString);
+    free(binaryString);
+
+    // The node first, the count last: a node that sees the count also sees whom it is for,
+    // so the node asked by the previous regeneration cannot take the new tokens
+    __atomic_store_n(&runControl->regenerateNode, node, __ATOMIC_RELAXED);
+    __atomic_store_n(&runControl->regenerateTokens, gone, __ATOMIC_RELEASE);
+    kill(childs[node], SIGUSR2);
+
+    // Counted now, the run may end before the next check sees the walk move again
+    runControl->stalledNs += now - countedToNs;
+    countedToNs = now;
+
+    return timeoutMs;
+}
@@ -0,0 +1,36 @@
+#ifndef FAULT_H
+#define FAULT_H
+
+#include "hypercube.h"
+
+#define MAX_FAULTS 16 // faults that can be scheduled from the command line
+#define RANDOM_NODE -1 // fault target chosen among the live nodes when it fires
+
+enum faultKind {
+    FAULT_KILL,  // SIGKILL the node
+    FAULT_STALL, // SIGSTOP the node, SIGCONT it after a while
+    FAULT_RESUME // end of a stall, scheduled by the stall itself
+};
+
+/**
+ * A fault scheduled on the run clock, relative to the start of the run.
+ */
+struct fault {
+    enum faultKind kind;
+    int node;       // target node, or RANDOM_NODE
+    uint64_t atNs;  // when to inject the fault
+    uint64_t forNs; // duration of a stall
+    int done;
+};
+
+int addFault(const char *spec);
+
+void injectFault(enum faultKind kind, int node, uint64_t forNs, int n);
+
+int runDueFaults(int n);
+
+int walkingTokens();
+
+int watchdog(int n);
+
+#endif //FAULT_H
@@ -0,0 +1,151 @@
+#include "frame.h"
+
+
+/**
+ * Prepares the batch of an outgoing edge.
+ *
+ * batch The batch.
+ * source The sending node.
+ * destination The neighbour the edge leads to.
+ */
+void initBatch(struct frameBatch *batch, int source, int destination)
+{
+    batch->size = FRAME_BUFFER;
+    batch->bytes = malloc(batch->size);
+    if (batch->bytes == NULL)
+    {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    batch->used = 0;
+    batch->frames = 0;
+    batch->source = source;
+    batch->destination = destination;
+    batch->sequence = 0;
+}
+
+
+/**
+ * Encodes a frame at the end of a batch, stamped with the current time and the next
+ * sequence number of the edge. The frame goes out with the rest of the batch in a
+ * single write(), when the flush policy says so (see --flush).
+ *
+ * batch The batch of the edge.
+ * type The type of the frame.
+ * payload The payload, copied after the header.
+ * length The size of the payload in bytes.
+ * return The frame, valid until the next frame is appended to the batch.
+ */
+struct frameHeader *appendFrame(struct frameBatch *batch, enum frameType type, const void *payload, uint16_t length)
+{
+    size_t size = frameSize(length);
+
+    if (batch->used + size > batch->size)
+    {
+        while (batch->used + size > batch->size)
+            batch->size *= 2;
+        batch->bytes = realloc(batch->bytes, batch->size);
+        if (batch->bytes == NULL)
+        {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    struct frameHeader *frame = (struct frameHeader *)(batch->bytes + batch->used);
+    frame->type = type;
+    frame->length = length;
+    frame->source = batch->source;
+    frame->destination = batch->destination;
+    frame->sequence = batch->sequence++;
+    frame->timestamp = monotonicNs();
+    if (length)
+        memcpy(frame + 1, payload, length); // FRAME_STOP comes with a NULL payload
+    batch->used += size;
+    batch->frames++;
+    return frame;
+}
+
+
+void freeBatch(struct frameBatch *batch)
+{
+    free(batch->bytes);
+    batch->bytes = NULL;
+}
+
+
+/**
+ * Prepares the receive buffer of an inbound edge.
+ *
+ * decoder The receive buffer.
+ * source The neighbour the edge comes from.
+ * destination The receiving node.
+ */
+void initDecoder(struct frameDecoder *decoder, int source, int destination)
+{
+    decoder->head = 0;
+    decoder->used = 0;
+    decoder->source = source;
+    decoder->destination = destination;
+    decoder->sequence = 0;
+}
+
+
+/**
+ * Reads whatever the edge holds into the free end of its receive buffer. nextFrame()
+ * must have returned NULL since the last call, which leaves room for at least one byte.
+ *
+ * decoder The receive buffer of the edge.
+ * fd The read end of the pipe.
+ * return The result of read(): bytes read, 0 at end of file, -1 on error.
+ */
+ssize_t readFrames(struct frameDecoder *decoder, int fd)
+{
+    ssize_t r = read(fd, decoder->bytes + decoder->used, FRAME_BUFFER - decoder->used);
+
+    if (r > 0)
+        decoder->used += r;
+    return r;
+}
+
+
+/**
+ * Decodes the next complete frame of a receive buffer, without copying it.
+ *
+ * The frame is checked against the edge: source, destination and sequence number. When
+ * no complete frame is left, the start of the next one is moved to the front of the
+ * buffer for the next readFrames(), so a frame returned earlier must not be used after
+ * this function returned NULL.
+ *
+ * decoder The receive buffer of the edge.
+ * return The frame, in the buffer, or NULL if the buffer holds no complete frame.
+ */
+const struct frameHeader *nextFrame(struct frameDecoder *decoder)
+{
+    size_t available = decoder->used - decoder->head;
+
+    if (available >= sizeof(struct frameHeader))
+    {
+        const struct frameHeader *frame = (const struct frameHeader *)(decoder->bytes + decoder->head);
+        size_t size = frameSize(frame->length);
+
+        if (size > FRAME_BUFFER || frame->source != decoder->source ||
+            frame->destination != decoder->destination || frame->sequence != decoder->sequence)
+        {
+            fprintf(stderr, "bad frame from %u to %u: sequence %u, expected %u, length %u\n", frame->source,
+                    frame->destination, frame->sequence, decoder->sequence, frame->length);
+            exit(EXIT_FAILURE);
+        }
+        if (available >= size)
+        {
+            decoder->head += size;
+            decoder->sequence++;
+            return frame;
+        }
+    }
+
+    memmove(decoder->bytes, decoder->bytes + decoder->head, available);
+    decoder->used = available;
+    decoder->head = 0;
+    return NULL;
+}
@@ -0,0 +1,81 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include "hypercube.h"
+
+#define FRAME_BUFFER 4096 // bytes of the receive buffer of an edge, and initial size of a batch
+#define FRAME_ALIGN 8     // frames start on this boundary, so headers are read in place
+
+enum frameType {
+    FRAME_TOKEN, // payload: the token, an int
+    FRAME_STOP,  // no payload, the last frame sent on an edge (TOKEN_STOP)
+    FRAME_CREDIT // payload: an int, token frames of the reverse edge read since the last credit (--credits)
+};
+
+/**
+ * Header of a frame on an edge, followed by length bytes of payload and padding up to
+ * FRAME_ALIGN.
+ */
+struct frameHeader {
+    uint16_t type;        // enum frameType
+    uint16_t length;      // bytes of payload
+    uint32_t source;      // sending node
+    uint32_t destination; // receiving node
+    uint32_t sequence;    // frames sent before this one on the edge
+    uint64_t timestamp;   // monotonic time at which the frame was encoded
+};
+
+/**
+ * Frames encoded for one outgoing edge and not written yet. The buffer grows when a
+ * wake-up produces more frames than it holds.
+ */
+struct frameBatch {
+    char *bytes;
+    size_t used;
+    size_t size;
+    size_t frames; // frames in bytes
+    uint32_t source, destination;
+    uint32_t sequence; // sequence of the next frame
+};
+
+/**
+ * Receive buffer of one inbound edge. Frames are decoded in place: bytes up to head
+ * have been decoded, bytes from head to used wait for the rest of their frame.
+ */
+struct frameDecoder {
+    size_t head;
+    size_t used;
+    uint32_t source, destination;
+    uint32_t sequence; // sequence expected for the next frame
+    char bytes[FRAME_BUFFER] __attribute__((aligned(FRAME_ALIGN)));
+};
+
+/**
+ * Size of a frame carrying length bytes of payload, padding included.
+ */
+static inline size_t frameSize(size_t length)
+{
+    return (sizeof(struct frameHeader) + length + FRAME_ALIGN - 1) & ~(size_t)(FRAME_ALIGN - 1);
+}
+
+/**
+ * return The payload of a frame, right after its header.
+ */
+static inline const void *framePayload(const struct frameHeader *frame)
+{
+    return frame + 1;
+}
+
+void initBatch(struct frameBatch *batch, int source, int destination);
+
+struct frameHeader *appendFrame(struct frameBatch *batch, enum frameType type, const void *payload, uint16_t length);
+
+void freeBatch(struct frameBatch *batch);
+
+void initDecoder(struct frameDecoder *decoder, int source, int destination);
+
+ssize_t readFrames(struct frameDecoder *decoder, int fd);
+
+const struct frameHeader *nextFrame(struct frameDecoder *decoder);
+
+#endif //FRAME_H
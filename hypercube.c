@@ -1,13 +1,44 @@
+#define _GNU_SOURCE // F_GETPIPE_SZ
 #include "hypercube.h"
+#include "workloads.h"
+#include "control.h"
+#include "profile.h"
+#include "mailbox.h"
+#include "frame.h"
 #include <sys/stat.h>
+#include <sys/resource.h>
 
 int nbProcesses = 0;
 int nbPipes = 0;
 pid_t *childs;
 int **pipes;
 int *connectedPipes;
+struct nodeStats *nodeStats;
+struct startupTimes startup;
+struct arrival *arrivals = NULL;
+struct tokenState *tokenStates = NULL;
+static struct frameBatch *outBatches = NULL; // Frames not written yet, per outgoing edge of the node
 
-volatile sig_atomic_t n_sigusr1 = 1;
+/**
+ * Tokens waiting for credit on an outgoing edge, oldest first, with --credits. They get
+ * their frame, and so their sequence number, only once the edge has credit again; the
+ * frame is then stamped with the time the token was queued, so its hop latency includes
+ * the wait.
+ */
+struct pendingToken {
+    int token;
+    uint64_t queuedNs; // monotonic time at which the token was queued
+};
+
+struct pendingTokens {
+    struct pendingToken *entries;
+    int head, count, size;
+};
+
+static int *edgeCredits = NULL; // Token frames each outgoing edge may still carry, with --credits
+static int *edgeWindows = NULL; // Credits each outgoing edge started with
+static struct pendingTokens *pendingTokens = NULL; // Tokens waiting for credit, per outgoing edge
+struct options opts = { WORKLOAD_TOKEN, 1024, 1000, 0, 4096, 0, 0, 0, 0, 1, 0, SPAWN_COMPACT, 0, 0, 0, 0, 0, EDGES_PIPE, 1 << 20, FLUSH_WAKEUP, 0, 0, ROUTE_RANDOM };
 
 
 /**
@@ -30,6 +61,22 @@ char *intToBinary(int num, int n) {
 }
 
 
+/**
+ * Read the monotonic clock in nanoseconds.
+ * 
+ * CLOCK_MONOTONIC is system wide, so timestamps taken by different nodes can be
+ * compared with each other and with the parent.
+ * 
+ * return uint64_t The current time in nanoseconds
+ */
+uint64_t monotonicNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
 /**
  * Creates a specified number of pipes for inter-process communication.
  * 
@@ -43,6 +90,16 @@ char *intToBinary(int num, int n) {
  */
 void createPipes(int n)
 {
+    startup.startNs = monotonicNs();
+
+    // The cube needs 2 * n * 2^n descriptors, allow as many as the hard limit does
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max)
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
     nbPipes = (1<<n) * n; // Calculate the total number of pipes needed
     pipes = (int **)malloc(nbPipes * sizeof(int *)); // Allocate memory for pipe file descriptors
 
@@ -57,9 +114,68 @@ void createPipes(int n)
         }
      
     }
+    startup.pipesNs = monotonicNs() - startup.startNs;
+}
+
+
+
+/**
+ * Maps the per-node statistics page shared by the parent and all children.
+ * 
+ * The mapping is anonymous and shared, so it must be created before the children
+ * are forked. Each child only writes its own entry; the parent reads all of them
+ * after waitChild() to build the run summary.
+ * 
+ * n The dimension of the hypercube. One entry is allocated for each of the 2^n nodes.
+ */
+void createSharedStats(int n)
+{
+    nodeStats = mmap(NULL, (1<<n) * sizeof(struct nodeStats), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (nodeStats == MAP_FAILED)
+    {
+        perror("mmap");
+        exit(EXIT_FAILURE);
+    }
+
+    if (opts.workload == WORKLOAD_TOKEN)
+    {
+        tokenStates = mmap(NULL, opts.tokens * sizeof(struct tokenState), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (tokenStates == MAP_FAILED)
+        {
+            perror("mmap");
+            exit(EXIT_FAILURE);
+        }
+        for (int t = 0; t < opts.tokens; t++)
+        {
+            tokenStates[t].hops = 1; // A token counts the hops it has made, its injection is the first
+            tokenStates[t].holder = t % (1<<n); // See passTokenBody()
+        }
+    }
+
+    if (opts.spin || opts.adaptiveSpin)
+    {
+        arrivals = mmap(NULL, (1<<n) * sizeof(struct arrival), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (arrivals == MAP_FAILED)
+        {
+            perror("mmap");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (opts.profile || opts.counters || opts.wakeup)
+        createProfiles(n);
 }
 
 
+/**
+ * SIGUSR2 handler of the nodes. It only interrupts select(), after which a node checks
+ * whether the watchdog asked it to regenerate tokens and whether the run must stop.
+ */
+static void wakeNode(int signum)
+{
+    (void)signum;
+}
+
 
 /**
  * Creates a specified number of processes for a hypercube topology and establishes pipe connections between them.
@@ -78,6 +194,9 @@ void createProcesses(int n)
     nbProcesses = 1<<n; // Calculate the number of processes based on the dimension of the hypercube
     printf("nb of processes : %d\n", nbProcesses);
     childs = (pid_t *)malloc(nbProcesses*sizeof(pid_t)); // Allocate memory for storing child PIDs
+    runControl->startNs = runClockNs(); // Start of the run for --duration
+    uint64_t forkStart = monotonicNs();
+    fflush(NULL); // The children would print what is still buffered
 
     for (int i = 0; i < nbProcesses; i++)
     {
@@ -90,53 +209,24 @@ void createProcesses(int n)
         }
         else if (pid == 0) // Child process
         {
-            connectedPipes = (int *)malloc(n * 2 * sizeof(int)); // Allocate memory for storing connected pipe file descriptors
+            nodeStats[i].forkedNs = monotonicNs();
+            struct sigaction wake = { .sa_handler = wakeNode }; // No SA_RESTART, so select() returns
+            sigaction(SIGUSR2, &wake, NULL); // Before SIGUSR2 is unblocked, a wake-up must not kill the node
+            detachControl(); // Signals and control commands are handled by the parent only
+            signal(SIGPIPE, SIG_IGN); // A dead neighbour shows up as EPIPE instead
 
-            // Establish pipe connections with neighbors in the hypercube topology
-            for (int j = 0; j < n ; j++)
-            {
-                int neighbour = i ^ (1 << j); // Calculate neighbor's ID
-
-                // Store file descriptors for pipes connected to the neighbor
-                connectedPipes[2*j] = pipes[i * n + j][0];
-                connectedPipes[2*j + 1] = pipes[neighbour * n + j][1];
-
-                // Close the ends of the pipes that are not used by this process
-                close(pipes[i*n + j][1]);
-                close(pipes[neighbour * n +j][0]);
-            }
-
-            // Close all other pipes that are not connected to this process
-            for (int j = 0; j < nbPipes; j++)
-            {
-                int needClose = 1;
-
-                for(int k = 0; k < n * 2; k++)
-                {
-                    if (pipes[j][0] == connectedPipes[k] || pipes[j][1] == connectedPipes[k])
-                    {
-                        needClose = 0;
-                        break;
-                    }
-                }
-
-                if(needClose)
-                {
-                    close(pipes[j][0]);
-                    close(pipes[j][1]);
-                }
-            }
-            
-            passToken(i, connectedPipes, n); // Execute the token passing algorithm
+            wireChild(i, n); // Keep the ends of the pipes to the neighbours, close all the others
+            nodeStats[i].readyNs = monotonicNs();
 
-            // Close all connected pipes before exiting
-            for(int j = 0; j < n * 2; j++)
-            {
-                close(connectedPipes[j]);
-            }
+            childProcessLogic(i, n); // Execute the selected workload
 
             //free conectedPipes memory
             if (connectedPipes != NULL) {
+                // Close all connected pipes before exiting
+                for(int j = 0; j < n * 2; j++)
+                {
+                    close(connectedPipes[j]);
+                }
                 free(connectedPipes);
                 connectedPipes = NULL;
             }
@@ -148,8 +238,7 @@ void createProcesses(int n)
             childs[i] = pid; // Store the PID of the child process
         }
     }
-
-    signal(SIGUSR1, handler);
+    startup.forkNs = monotonicNs() - forkStart;
 
     // Close all ends of the pipes in the parent process
     for (int i = 0; i < nbPipes; i++)
@@ -158,8 +247,11 @@ void createProcesses(int n)
         close(pipes[i][1]);
     }
 
-    // Wait for all child processes to terminate
-    waitChild();
+    // Wait for all child processes to terminate, serving control commands meanwhile
+    controlLoop(n);
+    startup.reapedNs = monotonicNs();
+
+    reportRun(n);
 
     // Now that all child processes have finished, it's safe to free allocated memory
     freeMemory();
@@ -167,131 +259,100 @@ void createProcesses(int n)
 
 
 /**
- * Passes a token around the processes in a hypercube topology, simulating a token ring network.
- * This function simulates the passing of a token from one process to another in a hypercube topology.
- * It starts with process 0, increments the token, and passes it to a randomly selected neighbor.
- * Each process writes the token value and the time between receptions to a file named after its binary ID.
- * The process continues until the select call fails, indicating no more tokens are being passed.
+ * Runs the selected workload in a freshly wired child process, within the perf_event
+ * counters of the node with --counters.
  * 
- *  id The ID of the current process.
- *  connectedPipes An array of file descriptors for the pipes connected to this process.
- *  n The dimension of the hypercube, determining the number of neighbors each process has.
+ * myId The ID of the current process.
+ * n The dimension of the hypercube.
  */
-void passToken(int id, int *connectedPipes, int n) {
-    fd_set readfds; // Set of file descriptors to monitor for readability
-    int pipe_index; // Index of the pipe to use for sending the token
-    struct timeval stop, start = {0}; // Variables for tracking the time between token receptions
-
-    int token = 0; // The token to be passed around
-
-    // Convert n to a string for the directory name
-    char dirName[128]; // Assuming n will not exceed the length that can be represented in 128 characters
-    sprintf(dirName, "%d", n);
-
-    // Create the directory with read, write and execute permissions for the owner
-    // and with read and execute permissions for the group and others.
-    mkdir(dirName, S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH);
+void childProcessLogic(int myId, int n)
+{
+    int counters[NB_COUNTERS];
 
-    // Use the directory name in the filename
-    char *binaryString = intToBinary(id, n);
-    char *filename = malloc(snprintf(NULL, 0, "%s/%s", dirName, binaryString) + 1);
-    sprintf(filename, "%s/%s.txt", dirName, binaryString);
+    if (opts.counters)
+        openCounters(counters);
 
-    FILE *file = fopen(filename, "w");
-    if(file == NULL)
+    switch (opts.workload)
     {
-        perror("fopen");
-        exit(EXIT_FAILURE);
+    case WORKLOAD_SORT:
+        bitonicSort(myId, n, opts.blockSize);
+        break;
+    case WORKLOAD_ALLTOALL:
+        allToAllBenchmark(myId, n, opts.blockSize);
+        break;
+    case WORKLOAD_BARRIER:
+        barrierBenchmark(myId, n, opts.iterations);
+        break;
+    case WORKLOAD_GATHER:
+        gatherScatterBenchmark(myId, n, opts.blockSize, opts.root);
+        break;
+    case WORKLOAD_FFT:
+        fftBenchmark(myId, n, opts.blockSize);
+        break;
+    case WORKLOAD_STARTUP:
+        startupBenchmark(myId, n);
+        break;
+    case WORKLOAD_BANDWIDTH:
+        bandwidthBenchmark(myId, n, opts.payload);
+        break;
+    default:
+        if (opts.generic)
+            passToken(myId, connectedPipes, n); // Execute the token passing algorithm
+        else
+            nodeKernels[n].passToken(myId, connectedPipes);
+        break;
     }
 
-    srand(time(NULL)); // Seed the random number generator
-    
-    if (id == 0) { // If this is the initial process
-        gettimeofday(&start, NULL); // Record the current time
-        token++; // Increment the token
-        pipe_index = rand() % n; // Select a random neighbor
-        fprintf(file, "token: %d\n", token); // Write the starting token to the file
-        fflush(file);
-        printf("starting token : %d", token);
-
-        if (write(connectedPipes[2*pipe_index+1], &token, sizeof(token)) == -1) { // Send the token to the selected neighbor
-            perror("Write to pipe failed");
-            exit(EXIT_FAILURE);
-        }
-    }
+    if (opts.counters)
+        closeCounters(myId, counters);
+}
 
-    long microSec = 0; // Variable for calculating milliseconds
-      
-    int nfds = setReadfds(n, &readfds); // Set the file descriptors to monitor
-      
-    while(select(nfds+1, &readfds, NULL, NULL, NULL) > 0) { // Wait for a token to be received
 
-      for(int i = 0; i < n; i++) // Check all connected pipes
-      {
-        if(FD_ISSET(connectedPipes[2*i], &readfds)) // If a token is received
-        {
-          if(read(connectedPipes[2*i], &token, sizeof(token)) != sizeof(token)) // Read the token
-          {
-            perror("pipe read fail");
-            exit(EXIT_FAILURE);
-          }
-        }
-      }
-      token++; // Increment the token
-      
-      if(start.tv_sec == 0) // If this is the first token reception
-      {
-        gettimeofday(&start, NULL); // Record the current time
-        fprintf(file, "first received token: %d\n", token); // Write the token to the file
-        fflush(file);
-        printf("first received token : %d", token);
-      }
-      else { // For subsequent receptions
-        gettimeofday(&stop, NULL); // Record the current time
-        microSec = (stop.tv_sec - start.tv_sec)*1000000L + (stop.tv_usec - start.tv_usec); // Calculate the time difference
-        fprintf(file, "Token: %d, Time : %ld\n", token, microSec); // Write the token and time difference to the file
-        fflush(file);
-        printf("Token: %d, Time : %ld\n", token, microSec);
-        start = stop; // Update timeBefore for the next iteration
-      }
+/**
+ * Selects a random neighbour with rand() % n.
+ * 
+ * childId The ID of the current process.
+ * n The dimension of the hypercube.
+ * return The dimension of the selected neighbour.
+ */
+int chooseRandomNeighbour(int childId, int n)
+{
+    (void)childId;
+    return rand() % n;
+}
 
-      pipe_index = rand() % n; // Select a random neighbor
-      if (write(connectedPipes[2*pipe_index+1], &token, sizeof(int)) == -1) { // Send the token to the selected neighbor
-        perror("write failed");
-        exit(EXIT_FAILURE);
-      }
-      microSec = 0; // Reset the millisecond counter
-      
-      nfds = setReadfds(n, &readfds); // Reset the file descriptors to monitor
-        
-    }
 
-    fclose(file); // Close the file when done
+/**
+ * Selects a random neighbour without a modulo.
+ * 
+ * rand() returns 31 random bits, so (rand() * n) >> 31 is in [0, n). When n is a
+ * compile-time constant this is a multiply and a shift, or a single shift when n is
+ * a power of two.
+ */
+static inline __attribute__((always_inline)) int fastRandomNeighbour(const int n)
+{
+#if RAND_MAX == 2147483647
+    return (int)(((uint64_t)rand() * n) >> 31);
+#else
+    return rand() % n;
+#endif
 }
 
 
 /**
- * Prepares a set of file descriptors for reading and determines the highest file descriptor value.
- * 
- * This function initializes the file descriptor set `readfds` for use with the `select` function.
- * It adds the read ends of the pipes connected to the current process to the set. The function
- * also calculates the highest file descriptor number among the added descriptors, which is required
- * as an argument to the `select` function.
- * 
- * n The number of pipes connected to the current process. This is typically equal to the
- *          dimension of the hypercube, as each process is connected to `n` other processes.
- * readfds A pointer to an fd_set structure that will be filled with the file descriptors
- *                of the pipes that are to be monitored for readability.
- * 
- * return The highest file descriptor number among the added descriptors. This value is used as
- *         an argument to the `select` function to specify the range of file descriptors to be monitored.
+ * Body of setReadfds(), inlined so that the loop is unrolled when n is a constant.
+ * The pipes whose bit is set in closedEdges are left out of the set.
  */
-int setReadfds(int n, fd_set *readfds) {
+static inline __attribute__((always_inline)) int setReadfdsBody(int *connectedPipes, const int n, fd_set *readfds, uint32_t closedEdges)
+{
   int nfds = 0;
   FD_ZERO(readfds);
 
+  #pragma GCC unroll 20 // MAX_DIMENSION, the pragma does not expand macros
   for(int i = 0; i < n; i++)
   {
+    if (closedEdges & (1u << i))
+      continue;
     FD_SET(connectedPipes[2*i], readfds);
     if (connectedPipes[2*i] > nfds)
     {
@@ -303,57 +364,1351 @@ int setReadfds(int n, fd_set *readfds) {
 
 
 /**
- * Waits for all child processes to terminate.
+ * Tells a node spinning in spinForArrival() that a message was written to it.
+ */
+static inline __attribute__((always_inline)) void announceArrival(int node)
+{
+    if (arrivals != NULL)
+        __atomic_add_fetch(&arrivals[node].count, 1, __ATOMIC_RELEASE);
+}
+
+
+/**
+ * Busy-polls the arrival counter of a node for at most budgetNs before it blocks in select().
  * 
- * This function iterates through the list of child process IDs stored in `childs` and waits for each
- * child process to terminate using the `waitpid` system call. It ensures that the parent process waits
- * for all its child processes to complete their execution before proceeding. This is particularly useful
- * in a concurrent programming context where the parent process needs to perform cleanup or further processing
- * only after all child processes have finished.
+ * Senders bump the counter after each write to the node, so a change means that select()
+ * will return at once. A pause hint is issued between polls. The spin also ends when the
+ * watchdog asks the node to regenerate tokens, since its signal may land meanwhile.
  * 
- * param n The number of child processes to wait for. This parameter is currently unused in the function.
+ * return 1 if a message arrived during the spin, 0 if the budget ran out.
  */
-void waitChild() {
-  for (int i = 0; i < nbProcesses; i++) {
-    int state;
-    waitpid(childs[i], &state, 0);
-  }
+static inline __attribute__((always_inline)) int spinForArrival(int id, uint32_t seen, uint64_t budgetNs)
+{
+    uint64_t deadline = monotonicNs() + budgetNs;
+
+    while (__atomic_load_n(&arrivals[id].count, __ATOMIC_ACQUIRE) == seen)
+    {
+        if (runControl->regenerateTokens > 0 || monotonicNs() >= deadline)
+            return 0;
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    }
+    return 1;
+}
+
+
+static int flushBatches(int id, int *connectedPipes, int n, int specialised, uint32_t *deadEdges,
+                        struct nodeProfile *profile, uint64_t *mark, uint32_t edges);
+
+
+/**
+ * Credits of an edge with --credits: the token frames half its pipe holds, at most
+ * --credits. The other half is room for the credit and stop frames, which take no credit,
+ * and pipes shrink to a single page once the user owns too many of them.
+ *
+ * fd Either end of the pipe of the edge.
+ */
+static int edgeWindow(int fd)
+{
+    int capacity = fcntl(fd, F_GETPIPE_SZ);
+    int frames = capacity > 0 ? capacity / 2 / (int)frameSize(sizeof(int)) : 1;
+
+    if (frames < 1)
+        frames = 1;
+    return opts.credits < frames ? opts.credits : frames;
+}
+
+
+/**
+ * Queues a token on an outgoing edge that has no credit left, instead of blocking in
+ * write() on a full pipe.
+ */
+static void queuePending(int id, int dim, int token)
+{
+    struct pendingTokens *queue = &pendingTokens[dim];
+
+    if (queue->count == queue->size)
+    {
+        int size = queue->size ? queue->size * 2 : 64;
+        struct pendingToken *entries = malloc(size * sizeof(struct pendingToken));
+        if (entries == NULL)
+        {
+            perror("malloc");
+            exit(EXIT_FAILURE);
+        }
+        for (int k = 0; k < queue->count; k++)
+            entries[k] = queue->entries[(queue->head + k) % queue->size];
+        free(queue->entries);
+        queue->entries = entries;
+        queue->head = 0;
+        queue->size = size;
+    }
+    queue->entries[(queue->head + queue->count++) % queue->size] = (struct pendingToken){ token, monotonicNs() };
+    nodeStats[id].creditStalls++;
+    if ((uint64_t)queue->count > nodeStats[id].pendingPeak)
+        nodeStats[id].pendingPeak = queue->count;
+}
+
+
+/**
+ * Takes the oldest token queued on an outgoing edge, which must have one.
+ *
+ * queuedNs Where to store the time it was queued, or NULL.
+ * return The token.
+ */
+static int popPending(int dim, uint64_t *queuedNs)
+{
+    struct pendingTokens *queue = &pendingTokens[dim];
+    int token = queue->entries[queue->head].token;
+
+    if (queuedNs != NULL)
+        *queuedNs = queue->entries[queue->head].queuedNs;
+    queue->head = (queue->head + 1) % queue->size;
+    queue->count--;
+    return token;
+}
+
+
+/**
+ * Encodes the tokens queued on an outgoing edge, oldest first, as long as the edge has
+ * credit. They are written with the batch of the edge.
+ */
+static void releasePending(int dim)
+{
+    while (edgeCredits[dim] > 0 && pendingTokens[dim].count > 0)
+    {
+        uint64_t queuedNs;
+        int token = popPending(dim, &queuedNs);
+        edgeCredits[dim]--;
+        appendFrame(&outBatches[dim], FRAME_TOKEN, &token, sizeof(token))->timestamp = queuedNs;
+    }
+}
+
+
+/**
+ * return 1 if the flush policy wants a batch written without waiting for the end of the
+ * wake-up.
+ */
+static inline __attribute__((always_inline)) int batchDue(const struct frameBatch *batch)
+{
+    switch (opts.flush)
+    {
+    case FLUSH_IMMEDIATE:
+        return 1;
+    case FLUSH_COUNT:
+        return batch->frames >= (size_t)opts.flushThreshold;
+    case FLUSH_SIZE:
+        return batch->used >= (size_t)opts.flushThreshold;
+    default:
+        return 0;
+    }
+}
+
+
+/**
+ * Load of an outgoing edge as the sender sees it, for --route p2c.
+ *
+ * Over mailboxes it is the number of tokens in the mailbox of the neighbour. Over pipes
+ * it is what the node has queued for the edge: the frames batched during this wake-up
+ * and the tokens waiting for credit and the frames the neighbour has not credited back
+ * yet. main() requires --credits for p2c over pipes, without it the sender would not see
+ * what sits unread in the pipe.
+ */
+static inline __attribute__((always_inline)) int edgeLoad(int id, const int n, int dim)
+{
+    if (opts.transport != EDGES_PIPE)
+    {
+        struct ring *mailbox = &mailboxes[(id ^ (1 << dim)) * n + dim];
+        return mailbox->tail - __atomic_load_n(&mailbox->head, __ATOMIC_RELAXED);
+    }
+
+    return outBatches[dim].frames + edgeWindows[dim] - edgeCredits[dim] + pendingTokens[dim].count;
+}
+
+
+/**
+ * return A random dimension among those whose bit is set in live, which must not be 0.
+ */
+static inline __attribute__((always_inline)) int randomLiveNeighbour(uint32_t live)
+{
+    for (int k = rand() % __builtin_popcount(live); k > 0; k--)
+        live &= live - 1; // drop the lowest live neighbours to reach the k-th one
+    return __builtin_ctz(live);
 }
 
-void handler(int signum) 
+
+/**
+ * return 1 if a batch holds at least one token frame, for the wake-up probe.
+ */
+static int batchCarriesToken(const struct frameBatch *batch)
 {
-    printf("Caught signal %d\n", signum);
+    for (size_t offset = 0; offset < batch->used; offset += frameSize(((struct frameHeader *)(batch->bytes + offset))->length))
+        if (((struct frameHeader *)(batch->bytes + offset))->type == FRAME_TOKEN)
+            return 1;
+    return 0;
+}
 
-    if (signum == SIGUSR1)
+
+/**
+ * Sends a token to a random live neighbour, rerouting around dead ones.
+ * 
+ * While no neighbour is known dead the choice is the usual one. Otherwise the token goes
+ * to a random neighbour among the live ones, i.e. through another dimension. With --route
+ * p2c a second neighbour is drawn among the others and the token goes to the less loaded
+ * of the two (see edgeLoad()), the first one on a tie. Over pipes
+ * the token is encoded as a frame in the batch of the edge, written by flushBatches()
+ * at once if the batch is due (see --flush), else before the node waits again. With
+ * --credits, a token for an edge without credit is queued on the edge instead, and
+ * counts as sent.
+ * Over mailboxes it is sent at once, and a send failing with EPIPE means the neighbour
+ * has exited: it is added to deadEdges, counted as a reroute in the node statistics, and
+ * another neighbour is tried.
+ * 
+ * The neighbour chosen is recorded as the holder of the token in tokenStates, or
+ * HOLDER_LOST when there is none. With --profile the choice and the write are recorded
+ * as phases of the hop in profile, from mark.
+ * 
+ * token The index of the token in tokenStates.
+ * return The dimension the token was sent across, -1 if every neighbour is dead.
+ */
+static inline __attribute__((always_inline)) int forwardToken(int id, int *connectedPipes, const int n, const int specialised,
+                                                              uint32_t *deadEdges, int token,
+                                                              struct nodeProfile *profile, uint64_t *mark)
+{
+    for (;;)
     {
-        if (n_sigusr1)
+        int pipe_index;
+
+        if (*deadEdges == 0)
         {
-            for (int i = 0; i < nbProcesses; i++)
+            pipe_index = specialised ? fastRandomNeighbour(n) : chooseRandomNeighbour(id, n); // Select a random neighbor
+            if (opts.route == ROUTE_P2C && n > 1)
             {
-                kill(childs[i], SIGSTOP);
+                int other = pipe_index + 1 + (specialised ? fastRandomNeighbour(n - 1) : rand() % (n - 1));
+                if (other >= n)
+                    other -= n;
+                if (edgeLoad(id, n, other) < edgeLoad(id, n, pipe_index))
+                    pipe_index = other;
             }
         }
         else
         {
-            for (int i = 0; i < nbProcesses; i++)
+            uint32_t live = ((1u << n) - 1) & ~*deadEdges;
+            if (live == 0)
+            {
+                tokenStates[token].holder = HOLDER_LOST;
+                return -1;
+            }
+            pipe_index = randomLiveNeighbour(live);
+            live &= ~(1u << pipe_index);
+            if (opts.route == ROUTE_P2C && live != 0)
+            {
+                int other = randomLiveNeighbour(live);
+                if (edgeLoad(id, n, other) < edgeLoad(id, n, pipe_index))
+                    pipe_index = other;
+            }
+        }
+        if (profile)
+            recordPhase(profile, PHASE_CHOOSE, mark);
+        tokenStates[token].holder = id ^ (1 << pipe_index); // Before the send, the neighbour may forward it at once
+
+        if (opts.transport == EDGES_PIPE)
+        {
+            if (opts.credits && (edgeCredits[pipe_index] == 0 || pendingTokens[pipe_index].count > 0))
+            {
+                queuePending(id, pipe_index, token); // Sent once the neighbour returns credit
+            }
+            else
             {
-                kill(childs[i], SIGCONT);
+                if (opts.credits)
+                    edgeCredits[pipe_index]--;
+                appendFrame(&outBatches[pipe_index], FRAME_TOKEN, &token, sizeof(token)); // Send the token to the selected neighbor
+                if (batchDue(&outBatches[pipe_index]))
+                    flushBatches(id, connectedPipes, n, specialised, deadEdges, profile, mark, 1u << pipe_index);
             }
+            if (profile)
+                recordPhase(profile, PHASE_WRITE, mark);
+            return pipe_index;
         }
-        n_sigusr1 = !n_sigusr1;
 
-    }
-    else if (signum == SIGINT)
-    {
-        for (int i = 0; i < nbProcesses; i++)
+        if (opts.wakeup)
+            probeSend(id ^ (1 << pipe_index), n, pipe_index);
+        int written = mailboxSend(id, n, pipe_index, token);
+        if (profile)
+            recordPhase(profile, PHASE_WRITE, mark);
+        if (written != -1)
+        {
+            announceArrival(id ^ (1 << pipe_index));
+            return pipe_index;
+        }
+
+        if (errno != EPIPE)
         {
-            kill(childs[i], SIGINT);
+            perror("write failed");
+            exit(EXIT_FAILURE);
         }
+        *deadEdges |= 1u << pipe_index;
+        nodeStats[id].rerouted++;
     }
 }
 
-void freeMemory()
-{
+
+/**
+ * Writes the frames batched for the given neighbours, with one write() per edge.
+ * 
+ * With --wakeup, an edge whose batch carries a token is stamped for the wake-up probe right
+ * before its write(), so the time the frames spent in the batch is not counted.
+ * 
+ * A write failing with EPIPE means the neighbour has exited: it is added to deadEdges and
+ * the tokens of the frames it did not get are forwarded again through the live neighbours,
+ * counted as reroutes, and every batch is written again until none is left. So are the
+ * tokens queued for credit on an edge found dead. Tokens that find no live neighbour are
+ * marked lost in the token table.
+ *
+ * Not specialised on n like passTokenBody(): it runs once per wake-up, around system calls.
+ *
+ * edges The edges whose bit is set are written.
+ * return 1 if a write() was made, 0 if every batch was empty.
+ */
+static int flushBatches(int id, int *connectedPipes, int n, int specialised, uint32_t *deadEdges,
+                        struct nodeProfile *profile, uint64_t *mark, uint32_t edges)
+{
+    int wrote = 0;
+
+    for (int again = 1; again; )
+    {
+        again = 0;
+
+        for (int j = 0; j < n; j++)
+        {
+            struct frameBatch *batch = &outBatches[j];
+            size_t sent = 0;
+
+            if (!(edges & (1u << j)))
+                continue;
+            while (opts.credits && (*deadEdges & (1u << j)) && pendingTokens[j].count > 0)
+            {
+                nodeStats[id].rerouted++;
+                forwardToken(id, connectedPipes, n, specialised, deadEdges, popPending(j, NULL), profile, mark);
+                again = 1;
+                edges = ~0u;
+            }
+            if (opts.wakeup && batchCarriesToken(batch))
+                probeSend(id ^ (1 << j), n, j); // The tokens of the batch leave now, not when they were encoded
+            while (sent < batch->used)
+            {
+                ssize_t w = write(connectedPipes[2*j+1], batch->bytes + sent, batch->used - sent);
+                nodeStats[id].writes++;
+                wrote = 1;
+                if (w == -1 && errno == EINTR)
+                    continue;
+                if (w == -1 && errno == EPIPE)
+                    break;
+                if (w == -1)
+                {
+                    perror("write failed");
+                    exit(EXIT_FAILURE);
+                }
+                sent += w;
+            }
+            if (batch->used == 0)
+                continue;
+            if (sent == batch->used)
+            {
+                nodeStats[id].messages += batch->frames;
+                batch->used = 0;
+                batch->frames = 0;
+                announceArrival(id ^ (1 << j));
+                continue;
+            }
+
+            // Skip the frames written whole, the neighbour died with them
+            size_t offset = 0;
+            while (offset + frameSize(((struct frameHeader *)(batch->bytes + offset))->length) <= sent)
+            {
+                offset += frameSize(((struct frameHeader *)(batch->bytes + offset))->length);
+                nodeStats[id].messages++;
+            }
+
+            *deadEdges |= 1u << j;
+            size_t used = batch->used;
+            batch->used = 0;
+            batch->frames = 0;
+            for (; offset < used; offset += frameSize(((struct frameHeader *)(batch->bytes + offset))->length))
+            {
+                const struct frameHeader *frame = (const struct frameHeader *)(batch->bytes + offset);
+                int token;
+
+                if (frame->type != FRAME_TOKEN)
+                    continue;
+                memcpy(&token, framePayload(frame), sizeof(token));
+                nodeStats[id].rerouted++;
+                forwardToken(id, connectedPipes, n, specialised, deadEdges, token, profile, mark);
+                again = 1;
+                edges = ~0u;
+            }
+        }
+    }
+    return wrote;
+}
+
+
+/**
+ * Floods the shutdown message to every live neighbour.
+ * 
+ * A node sends it exactly once, as the last message on each of its outgoing edges: over
+ * pipes the pending batches are written first, and the STOP frames are batched alone. A
+ * neighbour found dead on the way (EPIPE) is added to deadEdges. Tokens still waiting for
+ * credit are dropped.
+ */
+static void broadcastStop(int id, int *connectedPipes, int n, int specialised, uint32_t *deadEdges,
+                          struct nodeProfile *profile, uint64_t *mark)
+{
+    int stop = TOKEN_STOP;
+
+    if (opts.transport == EDGES_PIPE)
+    {
+        for (int j = 0; opts.credits && j < n; j++)
+        {
+            while (pendingTokens[j].count > 0)
+            {
+                tokenStates[popPending(j, NULL)].holder = HOLDER_DROPPED;
+                nodeStats[id].dropped++;
+            }
+        }
+        flushBatches(id, connectedPipes, n, specialised, deadEdges, profile, mark, ~0u);
+        for (int j = 0; j < n; j++)
+            if (!(*deadEdges & (1u << j)))
+                appendFrame(&outBatches[j], FRAME_STOP, NULL, 0);
+        flushBatches(id, connectedPipes, n, specialised, deadEdges, profile, mark, ~0u);
+        return;
+    }
+
+    for (int j = 0; j < n; j++)
+    {
+        if (*deadEdges & (1u << j))
+            continue;
+        if (mailboxSend(id, n, j, stop) == -1) {
+            if (errno == EPIPE)
+            {
+                *deadEdges |= 1u << j;
+                continue;
+            }
+            perror("write failed");
+            exit(EXIT_FAILURE);
+        }
+        announceArrival(id ^ (1 << j));
+    }
+}
+
+
+/**
+ * Starts the shutdown of the run from this node: records when the first node started it
+ * and floods the shutdown message (see broadcastStop()).
+ */
+static void startShutdown(int id, int *connectedPipes, int n, int specialised, uint32_t *deadEdges,
+                          struct nodeProfile *profile, uint64_t *mark)
+{
+    uint64_t expected = 0;
+
+    __atomic_compare_exchange_n(&runControl->shutdownNs, &expected, monotonicNs(), 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    broadcastStop(id, connectedPipes, n, specialised, deadEdges, profile, mark);
+}
+
+
+/**
+ * Returns the bucket of a hop latency in the log-linear hop histogram. Latencies below
+ * 2^(HOP_SUB_BITS + 1) ns have a bucket each, and every power of two above is split into
+ * 2^HOP_SUB_BITS buckets of equal width, so a percentile is known within 1/2^HOP_SUB_BITS
+ * of its value instead of a factor of two.
+ */
+static inline __attribute__((always_inline)) int hopBucket(uint64_t ns)
+{
+    if (ns < (1u << HOP_SUB_BITS))
+        return ns;
+
+    int exponent = 63 - __builtin_clzll(ns);
+    if (exponent >= LATENCY_BUCKETS)
+        return HOP_BUCKETS - 1;
+    return ((exponent - HOP_SUB_BITS + 1) << HOP_SUB_BITS) + ((ns >> (exponent - HOP_SUB_BITS)) & ((1 << HOP_SUB_BITS) - 1));
+}
+
+
+/**
+ * Records the latency of a token, from its send to the read() that took it.
+ */
+static inline __attribute__((always_inline)) void recordHop(int id, uint64_t sentNs, uint64_t readNs)
+{
+    uint64_t ns = readNs > sentNs ? readNs - sentNs : 0;
+
+    nodeStats[id].hopSamples++;
+    nodeStats[id].hopTotalNs += ns;
+    if (ns > nodeStats[id].hopMaxNs)
+        nodeStats[id].hopMaxNs = ns;
+    nodeStats[id].hopHistogram[hopBucket(ns)]++;
+}
+
+
+/**
+ * Returns the upper bound of the bucket of the hop histogram holding the given fraction
+ * of the hops, no larger than the slowest hop.
+ */
+static uint64_t hopPercentile(const uint64_t *histogram, uint64_t count, double fraction, uint64_t maxNs)
+{
+    uint64_t seen = 0, end = maxNs;
+
+    if (count == 0)
+        return 0;
+    for (int b = 0; b < HOP_BUCKETS; b++)
+    {
+        seen += histogram[b];
+        if (seen > 0 && seen >= fraction * count)
+        {
+            if (b < (1 << HOP_SUB_BITS))
+                end = b + 1;
+            else
+            {
+                int exponent = (b >> HOP_SUB_BITS) + HOP_SUB_BITS - 1;
+                uint64_t sub = b & ((1 << HOP_SUB_BITS) - 1);
+                end = ((1ull << HOP_SUB_BITS) + sub + 1) << (exponent - HOP_SUB_BITS);
+            }
+            break;
+        }
+    }
+    return end < maxNs ? end : maxNs;
+}
+
+
+/**
+ * Passes a token around the processes in a hypercube topology, simulating a token ring network.
+ * This function simulates the passing of a token from one process to another in a hypercube topology.
+ * Node i % 2^n injects token i, for each of the --tokens tokens. Each time a process receives a token,
+ * it increments it and passes it to a randomly selected neighbor.
+ * Each process writes the token value and the time between receptions to a file named after its binary ID.
+ * 
+ * The run ends with a termination protocol. A token that reaches --hops is not forwarded, and the node
+ * retiring the last one starts the shutdown; so does a node forwarding a token after --duration seconds
+ * or after the parent received a stop command, and any node waking up then, since a node waits no longer
+ * than the time left and the parent interrupts the waits with SIGUSR2 on stop. Starting the shutdown means flooding TOKEN_STOP to every
+ * neighbour, and a node receiving its first TOKEN_STOP floods it too, dropping the tokens it receives
+ * from then on. Since TOKEN_STOP is the last message a node sends on each edge, a node that has received
+ * it from all its n neighbours knows that its inbound pipes are empty: it flushes its statistics and
+ * returns, and no process ever writes to a neighbour that has already exited.
+ * 
+ * Pausing is cooperative: while the parent has pauseRequested set, the tokens a node receives are
+ * parked at the hop boundary, before being counted or forwarded, and reported in parkedTokens. A node
+ * holding parked tokens polls for the resume every millisecond. Times are taken on runClockNs(), which
+ * stands still while the cube is paused, so the time between receptions written to the file and the
+ * hop rate do not include the pauses; a reception whose interval spans a pause is marked in the file.
+ * 
+ * A neighbour that dies (see --fault) is detected by end of file on its edge or EPIPE when writing to
+ * it. Its edge then counts as closed for the termination protocol and forwardToken() reroutes the
+ * tokens through the live neighbours. Tokens lost with a dead node are injected again by the node
+ * the parent's watchdog picks (see --watchdog), which interrupts select() with SIGUSR2.
+ * 
+ * Messages travel on the pipes as frames (see frame.h). The frames a node produces during one wake-up
+ * are batched per edge and written with one write() per edge before the node waits again, or earlier
+ * as --flush asks, and a read() takes every frame the edge holds, decoded in place in the receive
+ * buffer of the edge.
+ * 
+ * With --credits a node may only have so many token frames unread on each outgoing edge, less than
+ * its pipe holds, so write() never blocks on a full pipe and two neighbours writing to each other
+ * cannot lock up. The receiver returns credits with a FRAME_CREDIT on the reverse edge once it has
+ * read half of them, and tokens without credit wait in the pending queue of their edge.
+ * 
+ * With --transport futex or eventfd the pipes are replaced by the mailboxes of mailbox.c: waitMailboxes()
+ * stands for select() and mailboxReceive() for read(), with the same end of file when the
+ * neighbour has exited, and mailboxSend() fails with EPIPE like write(). Mailboxes hold the token
+ * and the time it was sent, for the hop latency.
+ * 
+ *  id The ID of the current process.
+ *  connectedPipes An array of file descriptors for the pipes connected to this process.
+ *  n The dimension of the hypercube, determining the number of neighbors each process has.
+ *  specialised 1 when n is a compile-time constant (see nodeKernels), to use the modulo-free
+ *              neighbour choice. 0 keeps the generic rand() % n.
+ */
+static inline __attribute__((always_inline)) void passTokenBody(int id, int *connectedPipes, const int n, const int specialised) {
+    fd_set readfds; // Set of file descriptors to monitor for readability
+    uint64_t start = 0; // Run clock at the previous token reception
+    uint64_t pausedAtStart = 0; // Paused time already excluded at the previous token reception
+
+    int token = 0; // The token to be passed around, its index in tokenStates
+    int hops = 0; // The hops it has made
+    int stopping = 0; // Set once this node has flooded TOKEN_STOP
+    int stopsReceived = 0; // Number of neighbours this node received TOKEN_STOP from
+    uint32_t closedEdges = 0; // Inbound pipes that delivered TOKEN_STOP or end of file, nothing follows it
+    uint32_t deadEdges = 0; // Neighbours found dead, by end of file or EPIPE
+    int heldSize = opts.tokens > n ? opts.tokens : n; // Regenerated tokens can outnumber --tokens
+    int *held = malloc(heldSize * sizeof(int)); // Tokens received and not handled yet
+    int nbHeld = 0, parked = 0; // Tokens in held, and how many of them are reported as parked
+    struct nodeProfile *profile = opts.profile ? &nodeProfiles[id] : NULL; // Phases of the hops, with --profile
+    uint64_t mark = readCycles(); // End of the last phase recorded
+    uint32_t seenArrivals = 0; // Arrival counter of the node when select() last returned
+    uint64_t averageWaitNs = 0; // Moving average of the time spent waiting for a message
+    int adaptive = opts.adaptiveSpin && (1 << n) <= sysconf(_SC_NPROCESSORS_ONLN); // Idle nodes sleep on crowded machines
+    const int usePipes = opts.transport == EDGES_PIPE;
+    struct frameDecoder *decoders = NULL; // Receive buffer of each inbound pipe
+    int owed[MAX_DIMENSION] = { 0 }; // Token frames read on each inbound pipe and not credited back yet
+    int creditAt[MAX_DIMENSION] = { 0 }; // Frames owed on each inbound pipe that make the node return credit, half its window
+
+    if (usePipes)
+    {
+        outBatches = malloc(n * sizeof(struct frameBatch));
+        decoders = malloc(n * sizeof(struct frameDecoder));
+        if (outBatches == NULL || decoders == NULL)
+        {
+            perror("malloc");
+            exit(EXIT_FAILURE);
+        }
+        for (int j = 0; j < n; j++)
+        {
+            initBatch(&outBatches[j], id, id ^ (1 << j));
+            initDecoder(&decoders[j], id ^ (1 << j), id);
+        }
+    }
+    if (usePipes && opts.credits)
+    {
+        edgeCredits = malloc(n * sizeof(int));
+        edgeWindows = malloc(n * sizeof(int));
+        pendingTokens = calloc(n, sizeof(struct pendingTokens));
+        if (edgeCredits == NULL || edgeWindows == NULL || pendingTokens == NULL)
+        {
+            perror("malloc");
+            exit(EXIT_FAILURE);
+        }
+        for (int j = 0; j < n; j++)
+        {
+            edgeCredits[j] = edgeWindows[j] = edgeWindow(connectedPipes[2*j+1]);
+            creditAt[j] = (edgeWindow(connectedPipes[2*j]) + 1) / 2;
+        }
+    }
+
+    // Convert n to a string for the directory name
+    char dirName[128]; // Assuming n will not exceed the length that can be represented in 128 characters
+    sprintf(dirName, "%d", n);
+
+    // Create the directory with read, write and execute permissions for the owner
+    // and with read and execute permissions for the group and others.
+    mkdir(dirName, S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH);
+
+    // Use the directory name in the filename
+    char *binaryString = intToBinary(id, n);
+    char *filename = malloc(snprintf(NULL, 0, "%s/%s.txt", dirName, binaryString) + 1);
+    sprintf(filename, "%s/%s.txt", dirName, binaryString);
+
+    FILE *file = fopen(filename, "w");
+    if(file == NULL)
+    {
+        perror("fopen");
+        exit(EXIT_FAILURE);
+    }
+
+    srand(time(NULL)); // Seed the random number generator
+    
+    for (int t = id; t < opts.tokens; t += 1<<n) { // Inject the tokens assigned to this process
+        start = runClockNs(); // Record the current time
+        hops = tokenStates[t].hops; // A token counts the hops it has made
+        if (runControl->logging)
+        {
+            fprintf(file, "token: %d\n", hops); // Write the starting token to the file
+            fflush(file);
+        }
+        if (runControl->verbose)
+            printf("starting token : %d", hops);
+
+        forwardToken(id, connectedPipes, n, specialised, &deadEdges, t, profile, &mark); // Send the token to a random neighbor
+    }
+
+    long microSec = 0; // Variable for calculating milliseconds
+      
+    int nfds = usePipes ? setReadfdsBody(connectedPipes, n, &readfds, closedEdges) : 0; // Set the file descriptors to monitor
+      
+    while(stopsReceived < n) { // Until every neighbour has sent its last message
+
+      if (__atomic_load_n(&runControl->regenerateTokens, __ATOMIC_ACQUIRE) > 0 && runControl->regenerateNode == id)
+      {
+        // The watchdog found the walk stalled: inject the lost tokens again, each from its own hop count
+        __atomic_exchange_n(&runControl->regenerateTokens, 0, __ATOMIC_SEQ_CST);
+        runControl->regeneratedNs = runClockNs();
+        for (int t = 0; t < opts.tokens; t++)
+        {
+          if (!tokenStates[t].regenerate || tokenStates[t].holder != id)
+            continue;
+          tokenStates[t].regenerate = 0;
+          if (stopping)
+          {
+            tokenStates[t].holder = HOLDER_DROPPED;
+            nodeStats[id].dropped++;
+            continue;
+          }
+          if (runControl->logging)
+          {
+            fprintf(file, "regenerated token: %d\n", tokenStates[t].hops);
+            fflush(file);
+          }
+          forwardToken(id, connectedPipes, n, specialised, &deadEdges, t, profile, &mark);
+        }
+      }
+
+      // A stop command or the end of --duration ends the run even when no token reaches this node
+      uint64_t leftNs = UINT64_MAX; // Run time left before --duration
+      if (opts.duration && !stopping)
+      {
+        uint64_t elapsed = runClockNs() - runControl->startNs;
+        leftNs = elapsed < opts.duration ? opts.duration - elapsed : 0;
+      }
+      if (!stopping && (runControl->stopRequested || leftNs == 0))
+      {
+        stopping = 1;
+        startShutdown(id, connectedPipes, n, specialised, &deadEdges, profile, &mark);
+      }
+
+      if (usePipes)
+      {
+        // Nothing stays batched while the node waits
+        if (flushBatches(id, connectedPipes, n, specialised, &deadEdges, profile, &mark, ~0u) && profile)
+          recordPhase(profile, PHASE_WRITE, &mark);
+      }
+
+      uint64_t timeoutNs = parked ? 1000000 : leftNs; // Parked tokens poll for the resume every millisecond
+      if (leftNs < timeoutNs)
+        timeoutNs = leftNs;
+      struct timeval timeout = { timeoutNs / 1000000000, timeoutNs % 1000000000 / 1000 };
+      uint64_t sleptNs = opts.wakeup || arrivals ? monotonicNs() : 0;
+
+      // Spin first when the next message is expected before a wake-up would take
+      uint64_t budgetNs = adaptive ? (2 * averageWaitNs <= MAX_SPIN_NS ? 2 * averageWaitNs : 0) : opts.spin;
+      if (budgetNs > 0 && !parked)
+      {
+        if (spinForArrival(id, seenArrivals, budgetNs))
+          nodeStats[id].spinHits++;
+        else
+          nodeStats[id].spinMisses++;
+      }
+      int ready = usePipes ? select(nfds+1, &readfds, NULL, NULL, timeoutNs != UINT64_MAX ? &timeout : NULL) // Wait for a token to be received
+                           : waitMailboxes(id, n, closedEdges, timeoutNs != UINT64_MAX ? (int)((timeoutNs + 999999) / 1000000) : -1);
+      if (ready == -1) {
+        if (errno == EINTR)
+        {
+          if (usePipes)
+            nfds = setReadfdsBody(connectedPipes, n, &readfds, closedEdges);
+          continue;
+        }
+        perror("select");
+        exit(EXIT_FAILURE);
+      }
+      if (profile)
+        recordPhase(profile, PHASE_WAIT, &mark);
+      uint64_t wokeNs = opts.wakeup || arrivals ? monotonicNs() : 0;
+      if (arrivals != NULL)
+      {
+        seenArrivals = __atomic_load_n(&arrivals[id].count, __ATOMIC_ACQUIRE);
+        averageWaitNs = (averageWaitNs * 7 + (wokeNs - sleptNs)) / 8;
+      }
+
+      #pragma GCC unroll 20 // MAX_DIMENSION, the pragma does not expand macros
+      for(int i = 0; i < n; i++) // Check all connected pipes
+      {
+        int eof = 0, taken = 0;
+        uint64_t readNs = 0; // End of the read() of the frames, for their hop latency
+        if (usePipes)
+        {
+          if(!FD_ISSET(connectedPipes[2*i], &readfds)) // If no token is received
+            continue;
+          ssize_t r = readFrames(&decoders[i], connectedPipes[2*i]); // Read the frames
+          nodeStats[id].reads++;
+          if (r == -1)
+          {
+            perror("pipe read fail");
+            exit(EXIT_FAILURE);
+          }
+          readNs = monotonicNs();
+          eof = r == 0;
+        }
+        else if (closedEdges & (1u << i))
+          continue;
+
+        // Take every message that arrived on the edge: the frames read, or the tokens in the mailbox
+        for (;;)
+        {
+          if (usePipes)
+          {
+            const struct frameHeader *frame = nextFrame(&decoders[i]);
+            if (frame == NULL)
+              break;
+            if (frame->type == FRAME_CREDIT) // The neighbour has read tokens, send it those waiting
+            {
+              int credit;
+              memcpy(&credit, framePayload(frame), sizeof(credit));
+              edgeCredits[i] += credit;
+              releasePending(i);
+              continue;
+            }
+            if (frame->type == FRAME_STOP)
+              token = TOKEN_STOP;
+            else
+            {
+              memcpy(&token, framePayload(frame), sizeof(token));
+              recordHop(id, frame->timestamp, readNs);
+              owed[i]++;
+            }
+          }
+          else
+          {
+            uint64_t sentNs;
+            ssize_t r = mailboxReceive(id, n, i, &token, &sentNs);
+            if (r == -1)
+              break;
+            eof = r == 0;
+            if (eof)
+              break;
+            if (token != TOKEN_STOP)
+              recordHop(id, sentNs, monotonicNs());
+          }
+          taken++;
+
+          if (token == TOKEN_STOP) // A neighbour is shutting down, nothing follows
+          {
+            stopsReceived++;
+            closedEdges |= 1u << i;
+            if (!stopping)
+            {
+              stopping = 1;
+              broadcastStop(id, connectedPipes, n, specialised, &deadEdges, profile, &mark);
+            }
+            break;
+          }
+
+          if (nbHeld == heldSize && (held = realloc(held, (heldSize *= 2) * sizeof(int))) == NULL)
+          {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+          }
+          held[nbHeld++] = token;
+        }
+        if (taken == 0 && !eof && !usePipes)
+          continue; // Empty mailbox
+        if (opts.credits && !stopping && !(deadEdges & (1u << i)) && owed[i] >= creditAt[i])
+        {
+          appendFrame(&outBatches[i], FRAME_CREDIT, &owed[i], sizeof(owed[i])); // Written with the batch of the reverse edge
+          owed[i] = 0;
+        }
+        if (opts.wakeup && taken > 0)
+          probeWake(id, n, i, sleptNs, wokeNs);
+        if (profile)
+          recordPhase(profile, PHASE_READ, &mark);
+
+        if (eof) // The neighbour has died without sending TOKEN_STOP: nothing more will come
+        {
+          deadEdges |= 1u << i;
+          closedEdges |= 1u << i;
+          stopsReceived++;
+        }
+      }
+
+      if (__atomic_load_n(&runControl->pauseRequested, __ATOMIC_ACQUIRE) && !runControl->stopRequested && !stopping)
+      {
+        // Quiesce at the hop boundary: keep the tokens until the parent resumes the cube
+        if (nbHeld > parked)
+        {
+          __atomic_add_fetch(&runControl->parkedTokens, nbHeld - parked, __ATOMIC_SEQ_CST);
+          parked = nbHeld;
+        }
+        if (usePipes)
+          nfds = setReadfdsBody(connectedPipes, n, &readfds, closedEdges);
+        continue;
+      }
+
+      if (parked)
+      {
+        __atomic_sub_fetch(&runControl->parkedTokens, parked, __ATOMIC_SEQ_CST);
+        parked = 0;
+      }
+
+      for (int h = 0; h < nbHeld; h++)
+      {
+        token = held[h];
+
+        if (stopping) // Tokens still in flight when the shutdown started are dropped
+        {
+          tokenStates[token].holder = HOLDER_DROPPED;
+          nodeStats[id].dropped++;
+          continue;
+        }
+
+        hops = ++tokenStates[token].hops; // Increment the token
+
+        // Keep the shared statistics up to date, they are read by the control plane
+        uint64_t now = runClockNs();
+        nodeStats[id].lastHopNs = now;
+        if (nodeStats[id].items == 0)
+          nodeStats[id].firstHopNs = now;
+        nodeStats[id].items++;
+        nodeStats[id].token = hops;
+        
+        int shutdown = 0, forward = 0;
+        if (opts.hops && (uint64_t)hops >= opts.hops) // The token has made all its hops
+        {
+          tokenStates[token].holder = HOLDER_RETIRED;
+          shutdown = __atomic_add_fetch(&runControl->retiredTokens, 1, __ATOMIC_SEQ_CST) == opts.tokens;
+        }
+        else if (runControl->stopRequested ||
+                 (opts.duration && now - runControl->startNs >= opts.duration))
+        {
+          tokenStates[token].holder = HOLDER_DROPPED; // The last token handled before the shutdown
+          nodeStats[id].dropped++;
+          shutdown = 1;
+        }
+        else
+        {
+          forward = 1;
+        }
+        if (profile)
+          recordPhase(profile, PHASE_BOOKKEEPING, &mark);
+
+        if(start == 0) // If this is the first token reception
+        {
+          start = now; // Record the current time
+          pausedAtStart = runControl->pausedTotalNs;
+          if (runControl->logging)
+          {
+            fprintf(file, "first received token: %d\n", hops); // Write the token to the file
+            fflush(file);
+          }
+          if (runControl->verbose)
+            printf("first received token : %d", hops);
+        }
+        else { // For subsequent receptions
+          microSec = (now - start) / 1000; // Calculate the time difference, pauses excluded
+          if (runControl->logging)
+          {
+            if (runControl->pausedTotalNs != pausedAtStart) // Mark the intervals that spanned a pause
+              fprintf(file, "Paused: %llu us excluded\n", (unsigned long long)(runControl->pausedTotalNs - pausedAtStart) / 1000);
+            fprintf(file, "Token: %d, Time : %ld\n", hops, microSec); // Write the token and time difference to the file
+            fflush(file);
+          }
+          if (runControl->verbose)
+            printf("Token: %d, Time : %ld\n", hops, microSec);
+          start = now; // Update timeBefore for the next iteration
+          pausedAtStart = runControl->pausedTotalNs;
+        }
+        if (profile)
+          recordPhase(profile, PHASE_LOGGING, &mark);
+
+        if (forward)
+          forwardToken(id, connectedPipes, n, specialised, &deadEdges, token, profile, &mark); // HOLDER_LOST if every neighbour is dead
+
+        if (shutdown && !stopping)
+        {
+          stopping = 1;
+          startShutdown(id, connectedPipes, n, specialised, &deadEdges, profile, &mark);
+        }
+        microSec = 0; // Reset the millisecond counter
+      }
+      nbHeld = 0;
+      
+      if (usePipes)
+        nfds = setReadfdsBody(connectedPipes, n, &readfds, closedEdges); // Reset the file descriptors to monitor
+        
+    }
+
+    // Flush the statistics of the node before leaving
+    fprintf(file, "Hops: %llu, dropped: %llu\n", (unsigned long long)nodeStats[id].items, (unsigned long long)nodeStats[id].dropped);
+    if (profile)
+      writeProfile(file, profile);
+    nodeStats[id].exitNs = monotonicNs();
+
+    fclose(file); // Close the file when done
+    free(filename);
+    free(binaryString);
+    free(held);
+    if (usePipes)
+    {
+        for (int j = 0; j < n; j++)
+            freeBatch(&outBatches[j]);
+        free(outBatches);
+        outBatches = NULL;
+        free(decoders);
+    }
+    if (usePipes && opts.credits)
+    {
+        for (int j = 0; j < n; j++)
+            free(pendingTokens[j].entries);
+        free(pendingTokens);
+        pendingTokens = NULL;
+        free(edgeCredits);
+        edgeCredits = NULL;
+        free(edgeWindows);
+        edgeWindows = NULL;
+    }
+}
+
+void passToken(int id, int *connectedPipes, int n)
+{
+    passTokenBody(id, connectedPipes, n, 0);
+}
+
+
+/**
+ * Prepares a set of file descriptors for reading and determines the highest file descriptor value.
+ * 
+ * This function initializes the file descriptor set `readfds` for use with the `select` function.
+ * It adds the read ends of the pipes connected to the current process to the set. The function
+ * also calculates the highest file descriptor number among the added descriptors, which is required
+ * as an argument to the `select` function.
+ * 
+ * n The number of pipes connected to the current process. This is typically equal to the
+ *          dimension of the hypercube, as each process is connected to `n` other processes.
+ * readfds A pointer to an fd_set structure that will be filled with the file descriptors
+ *                of the pipes that are to be monitored for readability.
+ * 
+ * return The highest file descriptor number among the added descriptors. This value is used as
+ *         an argument to the `select` function to specify the range of file descriptors to be monitored.
+ */
+int setReadfds(int n, fd_set *readfds) {
+  return setReadfdsBody(connectedPipes, n, readfds, 0);
+}
+
+
+/**
+ * Keeps the 2n pipe ends of a child and closes all the other descriptors in O(n) system calls,
+ * with keepDescriptors() of edges.c, which transportbench and the mailboxes use as well. The
+ * ends are moved down to descriptors 3 to 2n + 2, below FD_SETSIZE whatever the dimension.
+ * 
+ * connectedPipes The ends kept by the child, updated to their new descriptors.
+ * n The dimension of the hypercube.
+ */
+static void compactDescriptors(int *connectedPipes, int n)
+{
+    int *kept[2 * MAX_DIMENSION];
+
+    for (int j = 0; j < 2 * n; j++)
+        kept[j] = &connectedPipes[j];
+    keepDescriptors(kept, 2 * n, pipes[nbPipes - 1][1] + 1); // The last pipe created holds the highest descriptors
+}
+
+
+/**
+ * Keeps the ends of the pipes connecting a child to its neighbours and closes all the others.
+ * 
+ * Pipe node * n + k carries the messages sent to node across dimension k. The child keeps
+ * the read end of its own n pipes and the write end of the pipe it shares with each
+ * neighbour. Every other pipe is identified from its index alone, so the scan over all
+ * the pipes needs no inner loop over connectedPipes. With --spawn compact (the default) the
+ * scan is replaced by compactDescriptors(). The mailbox transports have no pipes, see wireMailboxes().
+ * 
+ * id The ID of the current process.
+ * n The dimension of the hypercube.
+ */
+static inline __attribute__((always_inline)) void wireChildBody(int id, const int n)
+{
+    if (opts.transport != EDGES_PIPE)
+    {
+        wireMailboxes(id, n);
+        return;
+    }
+
+    connectedPipes = (int *)malloc(n * 2 * sizeof(int)); // Allocate memory for storing connected pipe file descriptors
+
+    // Establish pipe connections with neighbors in the hypercube topology
+    #pragma GCC unroll 20 // MAX_DIMENSION, the pragma does not expand macros
+    for (int j = 0; j < n ; j++)
+    {
+        int neighbour = id ^ (1 << j); // Calculate neighbor's ID
+
+        // Store file descriptors for pipes connected to the neighbor
+        connectedPipes[2*j] = pipes[id * n + j][0];
+        connectedPipes[2*j + 1] = pipes[neighbour * n + j][1];
+    }
+
+    if (opts.spawn == SPAWN_COMPACT)
+    {
+        compactDescriptors(connectedPipes, n);
+        return;
+    }
+
+    // Close the ends of the pipes that are not used by this process
+    for (int j = 0; j < nbPipes; j++)
+    {
+        int node = j / n;
+        int dim = j % n;
+
+        if (node == id)
+        {
+            close(pipes[j][1]);
+        }
+        else if (node == (id ^ (1 << dim)))
+        {
+            close(pipes[j][0]);
+        }
+        else
+        {
+            close(pipes[j][0]);
+            close(pipes[j][1]);
+        }
+    }
+}
+
+
+/**
+ * Node kernels specialised for each dimension.
+ * 
+ * Each instance compiles the token loop and the wiring with n as a constant, so the
+ * loops over the dimensions are unrolled into straight-line code and the neighbour
+ * choice uses fastRandomNeighbour(). The generic passToken() stays available with
+ * --generic to measure the difference.
+ */
+#define NODE_KERNEL(N) \
+    static void passToken##N(int id, int *connectedPipes) { passTokenBody(id, connectedPipes, N, 1); } \
+    static void wireChild##N(int id) { wireChildBody(id, N); }
+
+NODE_KERNEL(1)  NODE_KERNEL(2)  NODE_KERNEL(3)  NODE_KERNEL(4)  NODE_KERNEL(5)
+NODE_KERNEL(6)  NODE_KERNEL(7)  NODE_KERNEL(8)  NODE_KERNEL(9)  NODE_KERNEL(10)
+NODE_KERNEL(11) NODE_KERNEL(12) NODE_KERNEL(13) NODE_KERNEL(14) NODE_KERNEL(15)
+NODE_KERNEL(16) NODE_KERNEL(17) NODE_KERNEL(18) NODE_KERNEL(19) NODE_KERNEL(20)
+
+#define NODE_KERNEL_ENTRY(N) { passToken##N, wireChild##N }
+
+const struct nodeKernel nodeKernels[MAX_DIMENSION + 1] = {
+    { NULL, NULL },
+    NODE_KERNEL_ENTRY(1),  NODE_KERNEL_ENTRY(2),  NODE_KERNEL_ENTRY(3),  NODE_KERNEL_ENTRY(4),
+    NODE_KERNEL_ENTRY(5),  NODE_KERNEL_ENTRY(6),  NODE_KERNEL_ENTRY(7),  NODE_KERNEL_ENTRY(8),
+    NODE_KERNEL_ENTRY(9),  NODE_KERNEL_ENTRY(10), NODE_KERNEL_ENTRY(11), NODE_KERNEL_ENTRY(12),
+    NODE_KERNEL_ENTRY(13), NODE_KERNEL_ENTRY(14), NODE_KERNEL_ENTRY(15), NODE_KERNEL_ENTRY(16),
+    NODE_KERNEL_ENTRY(17), NODE_KERNEL_ENTRY(18), NODE_KERNEL_ENTRY(19), NODE_KERNEL_ENTRY(20)
+};
+
+
+/**
+ * Wires a freshly forked child, with the kernel specialised for n unless --generic is set.
+ * 
+ * id The ID of the current process.
+ * n The dimension of the hypercube.
+ */
+void wireChild(int id, int n)
+{
+    if (opts.generic)
+        wireChildBody(id, n);
+    else
+        nodeKernels[n].wireChild(id);
+}
+
+
+/**
+ * Waits for all child processes to terminate.
+ * 
+ * This function iterates through the list of child process IDs stored in `childs` and waits for each
+ * child process to terminate using the `waitpid` system call. It ensures that the parent process waits
+ * for all its child processes to complete their execution before proceeding. This is particularly useful
+ * in a concurrent programming context where the parent process needs to perform cleanup or further processing
+ * only after all child processes have finished.
+ * 
+ * param n The number of child processes to wait for. This parameter is currently unused in the function.
+ */
+void waitChild() {
+  for (int i = 0; i < nbProcesses; i++) {
+    int state;
+    waitpid(childs[i], &state, 0);
+  }
+}
+
+/**
+ * Prints the summary of a finished run from the shared statistics page.
+ * 
+ * n The dimension of the hypercube.
+ */
+void reportRun(int n)
+{
+    switch (opts.workload)
+    {
+    case WORKLOAD_SORT:
+        reportBitonicSort(n, opts.blockSize);
+        break;
+    case WORKLOAD_ALLTOALL:
+        reportAllToAll(n, opts.blockSize);
+        break;
+    case WORKLOAD_BARRIER:
+        reportBarrier(n, opts.iterations);
+        break;
+    case WORKLOAD_GATHER:
+        reportGatherScatter(n, opts.blockSize, opts.root);
+        break;
+    case WORKLOAD_FFT:
+        reportFft(n, opts.blockSize);
+        break;
+    case WORKLOAD_STARTUP:
+        reportStartup(n);
+        break;
+    case WORKLOAD_BANDWIDTH:
+        reportBandwidth(n, opts.payload);
+        break;
+    default:
+        reportToken(n);
+        break;
+    }
+
+    if (opts.counters)
+        reportCounters(n);
+}
+
+/**
+ * Prints the summary of a token run: total hops, hop rate over the whole cube and,
+ * for a bounded run, the time the termination protocol took to stop every node.
+ * Hop times are taken on the run clock, so the rate does not count the pauses. After a
+ * fault injection the line also counts the reroutes and the tokens lost, those neither
+ * retired nor dropped by the shutdown, to compare with a healthy run of the same command. With --watchdog it adds the stalls, the tokens
+ * regenerated, the time spent stalled and the resulting availability of the walk.
+ * 
+ * n The dimension of the hypercube.
+ */
+void reportToken(int n)
+{
+    uint64_t hops = 0, dropped = 0, rerouted = 0, lost = 0, first = UINT64_MAX, last = 0, lastExit = 0;
+    int maxToken = 0;
+
+    for (int i = 0; i < nbProcesses; i++)
+    {
+        hops += nodeStats[i].items;
+        dropped += nodeStats[i].dropped;
+        rerouted += nodeStats[i].rerouted;
+        if (nodeStats[i].items > 0 && nodeStats[i].firstHopNs < first)
+            first = nodeStats[i].firstHopNs;
+        if (nodeStats[i].lastHopNs > last)
+            last = nodeStats[i].lastHopNs;
+        if (nodeStats[i].exitNs > lastExit)
+            lastExit = nodeStats[i].exitNs;
+        if (nodeStats[i].token > maxToken)
+            maxToken = nodeStats[i].token;
+    }
+
+    // Every token ends retired, dropped by the shutdown, or lost: with a killed node, or stuck without live neighbour
+    for (int t = 0; t < opts.tokens; t++)
+        if (tokenStates[t].holder != HOLDER_RETIRED && tokenStates[t].holder != HOLDER_DROPPED)
+            lost++;
+
+    double seconds = hops > 0 ? (last - first) / 1e9 : 0;
+    printf("token n=%d kernel=%s route=%s tokens=%d hops=%llu dropped=%llu retired=%d max_token=%d time_ms=%.3f hops_per_s=%.0f",
+           n, opts.generic ? "generic" : "specialised", opts.route == ROUTE_P2C ? "p2c" : "random", opts.tokens, (unsigned long long)hops,
+           (unsigned long long)dropped, runControl->retiredTokens, maxToken,
+           seconds * 1e3, seconds > 0 ? hops / seconds : 0);
+    if (runControl->faults != 0)
+        printf(" faults=%d rerouted=%llu lost=%llu", runControl->faults, (unsigned long long)rerouted, (unsigned long long)lost);
+    if (opts.watchdog != 0)
+    {
+        uint64_t end = runControl->stalledUntilNs > last ? runControl->stalledUntilNs : last; // A run can end stalled
+        printf(" stalls=%d regenerated=%d stalled_ms=%.3f availability=%.4f", runControl->stalls, runControl->regenerated,
+               runControl->stalledNs / 1e6, end > runControl->startNs ? 1 - (double)runControl->stalledNs / (end - runControl->startNs) : 1);
+    }
+    if (opts.spin || opts.adaptiveSpin)
+    {
+        uint64_t hits = 0, misses = 0;
+        for (int i = 0; i < nbProcesses; i++)
+        {
+            hits += nodeStats[i].spinHits;
+            misses += nodeStats[i].spinMisses;
+        }
+        printf(" spin=%s spin_hits=%llu spin_misses=%llu", opts.adaptiveSpin ? "auto" : "fixed",
+               (unsigned long long)hits, (unsigned long long)misses);
+    }
+    if (opts.transport != EDGES_PIPE)
+    {
+        uint64_t sleeps = 0, wakes = 0;
+        for (int i = 0; i < nbProcesses; i++)
+        {
+            sleeps += nodeStats[i].sleeps;
+            wakes += nodeStats[i].wakes;
+        }
+        printf(" transport=%s sleeps=%llu wakes=%llu wakes_per_hop=%.3f", opts.transport == EDGES_FUTEX ? "futex" : "eventfd", (unsigned long long)sleeps,
+               (unsigned long long)wakes, hops > 0 ? (double)wakes / hops : 0);
+    }
+    else
+    {
+        static const char *policies[] = { "wakeup", "immediate", "count", "size" };
+        uint64_t messages = 0, writes = 0, reads = 0;
+        for (int i = 0; i < nbProcesses; i++)
+        {
+            messages += nodeStats[i].messages;
+            writes += nodeStats[i].writes;
+            reads += nodeStats[i].reads;
+        }
+        printf(" flush=%s messages=%llu writes=%llu reads=%llu syscalls_per_message=%.3f", policies[opts.flush],
+               (unsigned long long)messages, (unsigned long long)writes, (unsigned long long)reads,
+               messages > 0 ? (double)(writes + reads) / messages : 0);
+    }
+
+    uint64_t samples = 0, totalNs = 0, maxNs = 0, histogram[HOP_BUCKETS] = { 0 };
+    for (int i = 0; i < nbProcesses; i++)
+    {
+        samples += nodeStats[i].hopSamples;
+        totalNs += nodeStats[i].hopTotalNs;
+        if (nodeStats[i].hopMaxNs > maxNs)
+            maxNs = nodeStats[i].hopMaxNs;
+        for (int b = 0; b < HOP_BUCKETS; b++)
+            histogram[b] += nodeStats[i].hopHistogram[b];
+    }
+    printf(" hop_mean_us=%.2f hop_p50_us=%.2f hop_p99_us=%.2f hop_p999_us=%.2f hop_max_us=%.2f",
+           samples ? totalNs / 1e3 / samples : 0, hopPercentile(histogram, samples, 0.5, maxNs) / 1e3,
+           hopPercentile(histogram, samples, 0.99, maxNs) / 1e3, hopPercentile(histogram, samples, 0.999, maxNs) / 1e3,
+           maxNs / 1e3);
+    if (opts.credits)
+    {
+        uint64_t stalls = 0, peak = 0;
+        for (int i = 0; i < nbProcesses; i++)
+        {
+            stalls += nodeStats[i].creditStalls;
+            if (nodeStats[i].pendingPeak > peak)
+                peak = nodeStats[i].pendingPeak;
+        }
+        printf(" credits=%d credit_stalls=%llu pending_peak=%llu", opts.credits, (unsigned long long)stalls,
+               (unsigned long long)peak);
+    }
+    if (runControl->pausedTotalNs != 0)
+        printf(" paused_ms=%.3f", runControl->pausedTotalNs / 1e6);
+    if (runControl->shutdownNs != 0 && lastExit >= runControl->shutdownNs)
+        printf(" shutdown_us=%.1f", (lastExit - runControl->shutdownNs) / 1e3);
+    printf("\n");
+
+    if (opts.profile)
+        reportProfile(n);
+    if (opts.wakeup)
+        reportWakeup(n);
+}
+
+/**
+ * Prints the start-up phases of the cube: pipe creation, forks, descriptor pruning in the
+ * children (mean and slowest), the time at which the last child was ready, the time at
+ * which the first token was received, and the time at which the last child was reaped,
+ * all measured from the creation of the first pipe.
+ * 
+ * n The dimension of the hypercube.
+ */
+void reportStartup(int n)
+{
+    uint64_t prune = 0, slowestPrune = 0, lastReady = 0, firstToken = UINT64_MAX;
+
+    for (int i = 0; i < nbProcesses; i++)
+    {
+        uint64_t ns = nodeStats[i].readyNs - nodeStats[i].forkedNs;
+        prune += ns;
+        if (ns > slowestPrune)
+            slowestPrune = ns;
+        if (nodeStats[i].readyNs > lastReady)
+            lastReady = nodeStats[i].readyNs;
+        if (nodeStats[i].items > 0 && nodeStats[i].firstHopNs < firstToken)
+            firstToken = nodeStats[i].firstHopNs;
+    }
+
+    printf("startup n=%d spawn=%s pipes_ms=%.3f fork_ms=%.3f prune_us=%.1f prune_max_us=%.1f ready_ms=%.3f",
+           n, opts.spawn == SPAWN_SCAN ? "scan" : "compact", startup.pipesNs / 1e6, startup.forkNs / 1e6,
+           prune / 1e3 / nbProcesses, slowestPrune / 1e3, (lastReady - startup.startNs) / 1e6);
+    if (firstToken != UINT64_MAX)
+        printf(" first_token_ms=%.3f", (firstToken - startup.startNs) / 1e6);
+    printf(" reaped_ms=%.3f\n", (startup.reapedNs - startup.startNs) / 1e6);
+}
+
+void freeMemory()
+{
 
     // Free the memory allocated for each pipe in the pipes array
     if (pipes != NULL) {
@@ -367,6 +1722,21 @@ void freeMemory()
         pipes = NULL;
     }
 
+    if (nodeStats != NULL) {
+        munmap(nodeStats, nbProcesses * sizeof(struct nodeStats));
+        nodeStats = NULL;
+    }
+    if (arrivals != NULL) {
+        munmap(arrivals, nbProcesses * sizeof(struct arrival));
+        arrivals = NULL;
+    }
+    if (tokenStates != NULL) {
+        munmap(tokenStates, opts.tokens * sizeof(struct tokenState));
+        tokenStates = NULL;
+    }
+    freeProfiles();
+    freeMailboxes();
+
     // Free the memory allocated for the childs array
     if (childs != NULL) {
         free(childs);
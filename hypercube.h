@@ -4,6 +4,11 @@
 #include <stdio.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/mman.h>
 #include <sys/select.h>
 #include <sys/wait.h>
 #include <sys/time.h>
@@ -14,14 +19,190 @@
 #include <dirent.h>
 #include <signal.h>
 
+#define MAX_DIMENSION 20 // largest cube the process runtime accepts
+#define TOKEN_STOP -1 // message flooded over the cube to shut the token walk down
+#define HOLDER_RETIRED -1 // tokenState.holder of a token that made its --hops hops
+#define HOLDER_DROPPED -2 // tokenState.holder of a token dropped by the shutdown
+#define HOLDER_LOST -3    // tokenState.holder of a token whose node had no live neighbour left
+#define BANDWIDTH_VOLUME (64 << 20) // bytes sent along each edge per dimension and mode of the bandwidth workload
+#define MAX_SPIN_NS 50000 // longest spin of the adaptive wait, beyond it blocking is cheaper
+#define MAX_CREDITS 1024 // token frames a default 64 KiB pipe holds, with room left for the credit and stop frames
+#define LATENCY_BUCKETS 48 // bucket b of a latency histogram counts [2^(b-1), 2^b) cycles or nanoseconds
+#define HOP_SUB_BITS 3 // the hop histogram splits each power of two into 2^HOP_SUB_BITS buckets of equal width
+#define HOP_BUCKETS ((LATENCY_BUCKETS + 1 - HOP_SUB_BITS) << HOP_SUB_BITS) // buckets of the hop histogram, up to 2^LATENCY_BUCKETS ns
+
+/**
+ * Workloads a node can run once the hypercube is wired.
+ */
+enum workload {
+    WORKLOAD_TOKEN, // random walk of a single token (passToken)
+    WORKLOAD_SORT,    // distributed bitonic sort of node-resident keys
+    WORKLOAD_ALLTOALL, // all-to-all personalized exchange
+    WORKLOAD_BARRIER,  // latency of the dissemination barrier
+    WORKLOAD_GATHER,   // scatter from and gather to a root node
+    WORKLOAD_FFT,      // distributed radix-2 FFT
+    WORKLOAD_WALKSIM,  // in-process simulation of many random walkers, no fork
+    WORKLOAD_STARTUP,  // start-up cost of the cubes of dimension 1 to n
+    WORKLOAD_BANDWIDTH // throughput of large payloads on each dimension, write() against vmsplice()
+};
+
+enum spawn {
+    SPAWN_SCAN,   // a child closes every pipe end it does not use, one by one
+    SPAWN_COMPACT // a child moves its ends to the lowest descriptors and closes the rest in ranges
+};
+
+enum edgeTransport {
+    EDGES_PIPE, // one pipe per directed edge, a node waits on its n inbound pipes with select()
+    EDGES_FUTEX,  // one shared-memory mailbox per directed edge, a node sleeps on a single futex
+    EDGES_EVENTFD // the same mailboxes, a node sleeps on a single eventfd its senders write to
+};
+
+enum flushPolicy {
+    FLUSH_WAKEUP,    // the frames batched for an edge are written once per wake-up, before the node waits
+    FLUSH_IMMEDIATE, // every frame is written as soon as it is encoded, one write() per message
+    FLUSH_COUNT,     // an edge is also written as soon as it holds flushThreshold frames
+    FLUSH_SIZE       // an edge is also written as soon as it holds flushThreshold bytes
+};
+
+enum routePolicy {
+    ROUTE_RANDOM, // the next hop is a neighbour drawn uniformly
+    ROUTE_P2C     // two distinct neighbours are drawn, the token goes to the less loaded one
+};
+
+/**
+ * Run configuration, filled by main() from the command line.
+ */
+struct options {
+    enum workload workload;
+    int blockSize; // number of elements held by each node for block workloads
+    int iterations; // number of repetitions for latency workloads
+    int root;       // root node of the scatter and gather collectives
+    int walkers;    // number of walkers of the in-process simulation
+    uint64_t steps; // number of simulated steps, 0 to run until the cube is covered
+    int generic;    // 1 to run the generic node loops instead of the kernels specialised for n
+    uint64_t hops;     // hops after which a token is retired, 0 for no limit
+    uint64_t duration; // nanoseconds after which the walk is shut down, 0 for no limit
+    int tokens;        // number of tokens walking at the same time
+    uint64_t watchdog; // nanoseconds without any hop after which the tokens are regenerated, 0 to disable
+    enum spawn spawn;  // how a child prunes the pipe ends it does not use
+    int profile;       // 1 to time the phases of each hop of the token walk
+    int counters;      // 1 to read the perf_event counters of every node
+    int wakeup;        // 1 to measure the latency from a send to the wake-up of the receiver
+    uint64_t spin;     // nanoseconds a node busy-polls for a message before blocking, 0 to block at once
+    int adaptiveSpin;  // 1 to derive the spin budget from the waits observed by each node
+    enum edgeTransport transport; // what carries the tokens of the walk between neighbours
+    int payload;       // bytes of each message of the bandwidth workload
+    enum flushPolicy flush; // when the frames batched for an edge of the token walk are written
+    int flushThreshold;     // frames of FLUSH_COUNT, bytes of FLUSH_SIZE
+    int credits;       // token frames a node may send on an edge before the receiver returns credit, 0 for no flow control
+    enum routePolicy route; // how the token walk picks the next hop
+};
+
+/**
+ * Per-node results, kept in a page shared between the parent and all children
+ * so the parent can build a run summary once every child has exited.
+ */
+struct nodeStats {
+    uint64_t elapsedNs; // time spent in the workload
+    uint64_t items;     // number of elements processed by the node
+    uint32_t minKey;    // smallest key held at the end of a sort
+    uint32_t maxKey;    // largest key held at the end of a sort
+    int sorted;         // 1 if the local block ended up in ascending order
+    int valid;          // 1 if the data received by a collective was checked correct
+    double maxError;    // largest deviation from the expected result of a numeric workload
+    uint64_t bytes;     // number of bytes sent by the node
+    uint64_t roundNs[MAX_DIMENSION]; // time spent in each round of a collective
+    uint64_t splicedNs[MAX_DIMENSION]; // time to receive the vmsplice() payloads of each dimension
+    uint64_t minNs;     // fastest repetition of a latency workload
+    uint64_t maxNs;     // slowest repetition of a latency workload
+    uint64_t exitNs;    // monotonic time at which the node left its last barrier
+    uint64_t scatterStartNs, scatterEndNs; // monotonic bounds of the node's part of a scatter
+    uint64_t gatherStartNs, gatherEndNs;   // monotonic bounds of the node's part of a gather
+    int token;          // last token value seen by the node
+    uint64_t firstHopNs; // monotonic time of the first token received by the node
+    uint64_t lastHopNs;  // monotonic time of the last token received by the node
+    uint64_t dropped;    // tokens received after the node started shutting down
+    uint64_t rerouted;   // sends redirected because the chosen neighbour was dead
+    uint64_t forkedNs;   // monotonic time at which the child started
+    uint64_t readyNs;    // monotonic time at which the child had pruned its descriptors
+    uint64_t spinHits;   // spins that saw a message arrive before their budget ran out
+    uint64_t spinMisses; // spins that ended in a blocking select()
+    uint64_t sleeps;     // waits of the node that went to sleep in the kernel, mailbox transports only
+    uint64_t wakes;      // wake-ups the node issued to sleeping neighbours, mailbox transports only
+    uint64_t messages;   // frames written to the pipes of the node, pipe transport only
+    uint64_t writes;     // write() calls on the outgoing pipes of the node
+    uint64_t reads;      // read() calls on the inbound pipes of the node
+    uint64_t creditStalls; // tokens queued because their edge had no credit left, with --credits
+    uint64_t pendingPeak;  // most tokens queued at once on one edge of the node
+    uint64_t hopSamples;   // tokens received by the node
+    uint64_t hopTotalNs;   // sum of their latencies, from the send to the read()
+    uint64_t hopMaxNs;     // slowest of them
+    uint64_t hopHistogram[HOP_BUCKETS]; // their latencies in nanoseconds, log-linear (see hopBucket())
+};
+
+/**
+ * Where a token of the walk is, in a table shared by the parent and all children. The
+ * messages of the walk only carry the index of the token in the table: the node that
+ * receives it counts the hop there, and the node that sends it records the neighbour it
+ * goes to before the send, so the parent can tell a token still walking from one gone
+ * with a dead node. One cache line per token.
+ */
+struct tokenState {
+    int hops;       // hops made so far
+    int holder;     // node holding the token or the node it was sent to, or a HOLDER_ state
+    int regenerate; // set by the watchdog while holder has to inject the token again
+} __attribute__((aligned(64)));
+
+/**
+ * Messages written to a node so far, bumped by the senders so that a spinning node
+ * notices them without a system call. One cache line per node.
+ */
+struct arrival {
+    uint32_t count;
+} __attribute__((aligned(64)));
+
+/**
+ * Start-up phases timed by the parent, on the monotonic clock.
+ */
+struct startupTimes {
+    uint64_t startNs;  // before the first pipe is created
+    uint64_t pipesNs;  // time spent creating the n * 2^n pipes
+    uint64_t forkNs;   // time spent forking the 2^n children
+    uint64_t reapedNs; // monotonic time at which the last child was reaped
+};
+
+/**
+ * Node loops compiled for one value of n, see nodeKernels in hypercube.c.
+ */
+struct nodeKernel {
+    void (*passToken)(int id, int *connectedPipes);
+    void (*wireChild)(int id);
+};
+
+extern struct options opts;
+extern int nbProcesses;
+extern pid_t *childs;
+extern int *connectedPipes;
+extern struct nodeStats *nodeStats;
+extern struct startupTimes startup;
+extern struct arrival *arrivals;
+extern struct tokenState *tokenStates;
+extern const struct nodeKernel nodeKernels[MAX_DIMENSION + 1];
+
 char *intToBinary(int num, int n);
 
+uint64_t monotonicNs();
+
 void createPipes(int n);
 
+void createSharedStats(int n);
+
 void createProcesses(int dimension);
 
 int chooseRandomNeighbour( int childId, int n);
 
+void wireChild(int id, int n);
+
 void childProcessLogic(int myId, int n);
 
 int setReadfds(int n, fd_set *readfds);
@@ -30,8 +211,12 @@ void passToken(int id, int *connectedPipes, int n);
 
 void waitChild();
 
-void handler(int signum);
+void reportRun(int n);
+
+void reportToken(int n);
+
+void reportStartup(int n);
 
 void freeMemory();
 
-#endif //HYPERCUBE_H
\ No newline at end of file
+#endif //HYPERCUBE_H
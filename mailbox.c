@@ -0,0 +1,244 @@
+#define _GNU_SOURCE // close_range()
+#include "mailbox.h"
+#include <sched.h>
+#include <sys/eventfd.h>
+
+struct ring *mailboxes = NULL;
+struct doorbell *doorbells = NULL;
+static size_t mailboxesSize = 0;
+static int nbDoorbells = 0;
+static int *eventfds = NULL; // doorbell of each node with --transport eventfd
+
+
+/**
+ * Maps the mailboxes and the doorbells of the cube, shared by the parent and all children.
+ *
+ * They replace the pipes of the token walk with --transport futex or eventfd: a token is
+ * a message in the ring of the edge (see edges.c, shared with transportbench), and a node
+ * that finds all its mailboxes empty sleeps on a single doorbell, a futex or an eventfd,
+ * instead of watching n pipes with select().
+ *
+ * n The dimension of the hypercube.
+ */
+void createMailboxes(int n)
+{
+    mailboxesSize = ((size_t)n << n) * sizeof(struct ring);
+    nbDoorbells = 1 << n;
+    mailboxes = mapShared(mailboxesSize);
+    doorbells = mapShared(nbDoorbells * sizeof(struct doorbell));
+    if (mailboxes == NULL || doorbells == NULL)
+    {
+        perror("mmap");
+        exit(EXIT_FAILURE);
+    }
+
+    if (opts.transport != EDGES_EVENTFD)
+        return;
+    eventfds = malloc(nbDoorbells * sizeof(int));
+    if (eventfds == NULL)
+    {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    for (int id = 0; id < nbDoorbells; id++)
+    {
+        eventfds[id] = eventfd(0, 0);
+        if (eventfds[id] == -1)
+        {
+            perror("eventfd");
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+
+/**
+ * Wires a freshly forked child. The futex doorbells need no descriptor, so the child
+ * closes everything it inherited but the standard streams.
+ *
+ * With eventfd doorbells the child keeps its own, to sleep on, and those of its n
+ * neighbours, to ring them, at descriptors 3 to n + 3, moved there by
+ * keepDescriptors() as compactDescriptors() moves the pipe ends. Their entries in eventfds are updated, so
+ * the doorbell of a node is eventfds[node] in the parent and in the children alike.
+ *
+ * id The ID of the current process.
+ * n The dimension of the hypercube.
+ */
+void wireMailboxes(int id, int n)
+{
+    connectedPipes = NULL;
+    if (opts.transport != EDGES_EVENTFD)
+    {
+        close_range(3, ~0U, 0);
+        return;
+    }
+
+    int *kept[MAX_DIMENSION + 1];
+
+    kept[0] = &eventfds[id];
+    for (int dim = 0; dim < n; dim++)
+        kept[1 + dim] = &eventfds[id ^ (1 << dim)];
+    keepDescriptors(kept, n + 1, eventfds[nbDoorbells - 1] + 1); // The last eventfd created is the highest
+}
+
+
+/**
+ * Wakes a node up if it sleeps on its doorbell, see ringDoorbell().
+ *
+ * return 1 if a system call was made to wake the node.
+ */
+static int wakeNode(int node)
+{
+    return ringDoorbell(&doorbells[node], eventfds != NULL ? eventfds[node] : -1);
+}
+
+
+/**
+ * Stores a token in the mailbox of a neighbour, stamped with the current time, and rings
+ * its doorbell.
+ *
+ * A full mailbox makes the sender yield the processor until the neighbour catches up,
+ * as a full pipe would block it in write().
+ *
+ * id The ID of the sending node.
+ * n The dimension of the hypercube.
+ * dim The dimension of the edge, the neighbour is id ^ (1 << dim).
+ * token The token to send.
+ * return 0, or -1 with errno set to EPIPE if the neighbour has exited.
+ */
+int mailboxSend(int id, int n, int dim, int token)
+{
+    int node = id ^ (1 << dim);
+    struct message message = { token, monotonicNs() };
+
+    for (;;)
+    {
+        if (__atomic_load_n(&doorbells[node].exited, __ATOMIC_ACQUIRE))
+        {
+            errno = EPIPE;
+            return -1;
+        }
+        if (ringPush(&mailboxes[node * n + dim], &message) == 0)
+            break;
+        sched_yield();
+    }
+    nodeStats[id].wakes += wakeNode(node);
+    return 0;
+}
+
+
+/**
+ * Takes the next token out of the mailbox of an inbound edge, with the results of a
+ * read() on the pipe it replaces.
+ *
+ * id The ID of the receiving node.
+ * n The dimension of the hypercube.
+ * dim The dimension of the edge.
+ * token Where to store the token.
+ * sentNs Where to store the time at which it was sent.
+ * return sizeof(int) when a token was taken, 0 when the mailbox is empty and the
+ *        neighbour has exited (end of file), -1 when the mailbox is empty.
+ */
+int mailboxReceive(int id, int n, int dim, int *token, uint64_t *sentNs)
+{
+    struct ring *mailbox = &mailboxes[id * n + dim];
+    struct message message;
+
+    if (ringPop(mailbox, &message) == -1)
+    {
+        if (!__atomic_load_n(&doorbells[id ^ (1 << dim)].exited, __ATOMIC_ACQUIRE))
+            return -1;
+        if (ringPop(mailbox, &message) == -1)
+            return 0; // Its last messages were written before it exited
+    }
+
+    *token = message.token;
+    *sentNs = message.sentNs;
+    return sizeof(int);
+}
+
+
+/**
+ * The inbound edges of a node that waitMailboxes() watches.
+ */
+struct watchedEdges {
+    int id, n;
+    uint32_t closedEdges;
+};
+
+/**
+ * return 1 if an inbound edge that is not closed has a token or an exited neighbour.
+ */
+static int mailboxesPending(void *context)
+{
+    struct watchedEdges *edges = context;
+
+    for (int dim = 0; dim < edges->n; dim++)
+    {
+        if (edges->closedEdges & (1u << dim))
+            continue;
+        if (ringPending(&mailboxes[edges->id * edges->n + dim]) ||
+            __atomic_load_n(&doorbells[edges->id ^ (1 << dim)].exited, __ATOMIC_ACQUIRE))
+            return 1;
+    }
+    return 0;
+}
+
+
+/**
+ * Blocks a node until one of its inbound edges has something to read, the select() of
+ * the mailboxes. Closed edges are not watched.
+ *
+ * id The ID of the node.
+ * n The dimension of the hypercube.
+ * closedEdges The edges whose bit is set are not watched.
+ * timeoutMs Longest wait in milliseconds, -1 for none.
+ * return 0 when an edge may be read or the timeout expired, -1 with errno set to EINTR
+ *        when a signal interrupted the wait.
+ */
+int waitMailboxes(int id, int n, uint32_t closedEdges, int timeoutMs)
+{
+    struct watchedEdges edges = { id, n, closedEdges };
+    int r = waitDoorbell(&doorbells[id], eventfds != NULL ? eventfds[id] : -1, mailboxesPending, &edges, timeoutMs);
+
+    if (r != 0)
+        nodeStats[id].sleeps++;
+    return r == -1 ? -1 : 0;
+}
+
+
+/**
+ * Marks a reaped node as exited and wakes its neighbours up, which read it as the end
+ * of file on their edge from it, or EPIPE when they send to it. Called by the parent.
+ *
+ * node The ID of the node.
+ * n The dimension of the hypercube.
+ */
+void mailboxExited(int node, int n)
+{
+    __atomic_store_n(&doorbells[node].exited, 1, __ATOMIC_SEQ_CST);
+    for (int dim = 0; dim < n; dim++)
+        wakeNode(node ^ (1 << dim));
+}
+
+
+void freeMailboxes()
+{
+    if (mailboxes != NULL)
+    {
+        munmap(mailboxes, mailboxesSize);
+        mailboxes = NULL;
+    }
+    if (doorbells != NULL)
+    {
+        munmap(doorbells, nbDoorbells * sizeof(struct doorbell));
+        doorbells = NULL;
+    }
+    if (eventfds != NULL)
+    {
+        for (int id = 0; id < nbDoorbells; id++)
+            close(eventfds[id]);
+        free(eventfds);
+        eventfds = NULL;
+    }
+}
@@ -0,0 +1,24 @@
+#ifndef MAILBOX_H
+#define MAILBOX_H
+
+#include "hypercube.h"
+#include "edges.h"
+
+extern struct ring *mailboxes; // the rings of edges.c, one per directed edge
+extern struct doorbell *doorbells;
+
+void createMailboxes(int n);
+
+void wireMailboxes(int id, int n);
+
+int mailboxSend(int id, int n, int dim, int token);
+
+int mailboxReceive(int id, int n, int dim, int *token, uint64_t *sentNs);
+
+int waitMailboxes(int id, int n, uint32_t closedEdges, int timeoutMs);
+
+void mailboxExited(int node, int n);
+
+void freeMailboxes();
+
+#endif //MAILBOX_H
@@ -1,20 +1,313 @@
 #include "hypercube.h"
+#include "walksim.h"
+#include "control.h"
+#include "fault.h"
+#include "mailbox.h"
+#include <getopt.h>
+
+static void usage(char *name)
+{
+    printf("Usage: %s [options] <n>\n", name);
+    printf("  -w, --workload <name>     workload run by every node (default: token)\n");
+    printf("                            token, sort, alltoall, barrier, gather, fft, walksim, startup, bandwidth\n");
+    printf("  -b, --block <count>       elements held by each node (default: 1024)\n");
+    printf("  -B, --payload <KiB>       message size of the bandwidth workload, 64 to 16384 (default: 1024)\n");
+    printf("  -i, --iterations <count>  repetitions of latency workloads (default: 1000)\n");
+    printf("  -r, --root <id>           root node of scatter and gather (default: 0)\n");
+    printf("  -k, --walkers <count>     walkers of the in-process simulation (default: 4096)\n");
+    printf("  -s, --steps <count>       simulated steps, 0 until the cube is covered (default: 0)\n");
+    printf("  -g, --generic             run the generic node loops instead of the ones compiled for n\n");
+    printf("  -t, --tokens <count>      tokens walking at the same time (default: 1)\n");
+    printf("  -H, --hops <count>        retire a token after this many hops, end the run with the last one\n");
+    printf("  -d, --duration <seconds>  shut the token walk down after this time\n");
+    printf("  -C, --counters            read perf_event counters in every node, see <n>/counters.txt\n");
+    printf("  -L, --wakeup              measure the latency from a send to the wake-up of the receiver\n");
+    printf("  -P, --profile             time the phases of every hop of the token walk\n");
+    printf("  -p, --spin <us|auto>      busy-poll for a message this long before blocking, auto to adapt\n");
+    printf("  -T, --transport <name>    what carries the tokens of the walk, pipe, futex or eventfd (default: pipe)\n");
+    printf("  -F, --flush <policy>      when batched frames are written to a pipe, wakeup, immediate,\n");
+    printf("                            count:<frames> or size:<bytes> (default: wakeup)\n");
+    printf("  -c, --credits <frames>    flow control, tokens unread on an edge before its sender waits, 1 to %d\n", MAX_CREDITS);
+    printf("  -R, --route <policy>      next hop of a token, random or p2c, the less loaded of two (default: random)\n");
+    printf("  -S, --spawn <strategy>    descriptor pruning in the children, scan or compact (default: compact)\n");
+    printf("  -W, --watchdog <ms>       regenerate the tokens after this long without any hop\n");
+    printf("  -f, --fault <spec>        inject a fault, kill:<node|random>@<s> or stall:<node|random>@<s>+<s>\n");
+}
 
 int main(int argc, char *argv[]) 
 {
-    if (argc != 2) {
-        printf("Usage: %s <n>\n", argv[0]);
+    static struct option longOptions[] = {
+        {"workload", required_argument, NULL, 'w'},
+        {"block", required_argument, NULL, 'b'},
+        {"payload", required_argument, NULL, 'B'},
+        {"iterations", required_argument, NULL, 'i'},
+        {"root", required_argument, NULL, 'r'},
+        {"walkers", required_argument, NULL, 'k'},
+        {"steps", required_argument, NULL, 's'},
+        {"generic", no_argument, NULL, 'g'},
+        {"tokens", required_argument, NULL, 't'},
+        {"hops", required_argument, NULL, 'H'},
+        {"duration", required_argument, NULL, 'd'},
+        {"fault", required_argument, NULL, 'f'},
+        {"watchdog", required_argument, NULL, 'W'},
+        {"spawn", required_argument, NULL, 'S'},
+        {"profile", no_argument, NULL, 'P'},
+        {"counters", no_argument, NULL, 'C'},
+        {"wakeup", no_argument, NULL, 'L'},
+        {"spin", required_argument, NULL, 'p'},
+        {"transport", required_argument, NULL, 'T'},
+        {"flush", required_argument, NULL, 'F'},
+        {"credits", required_argument, NULL, 'c'},
+        {"route", required_argument, NULL, 'R'},
+        {NULL, 0, NULL, 0}
+    };
+    int opt;
+    char *end;
+
+    while ((opt = getopt_long(argc, argv, "w:b:B:i:r:k:s:gt:H:d:f:W:S:PCLp:T:F:c:R:", longOptions, NULL)) != -1) {
+        switch (opt) {
+        case 'w':
+            if (strcmp(optarg, "token") == 0) {
+                opts.workload = WORKLOAD_TOKEN;
+            } else if (strcmp(optarg, "sort") == 0) {
+                opts.workload = WORKLOAD_SORT;
+            } else if (strcmp(optarg, "alltoall") == 0) {
+                opts.workload = WORKLOAD_ALLTOALL;
+            } else if (strcmp(optarg, "barrier") == 0) {
+                opts.workload = WORKLOAD_BARRIER;
+            } else if (strcmp(optarg, "gather") == 0) {
+                opts.workload = WORKLOAD_GATHER;
+            } else if (strcmp(optarg, "fft") == 0) {
+                opts.workload = WORKLOAD_FFT;
+            } else if (strcmp(optarg, "walksim") == 0) {
+                opts.workload = WORKLOAD_WALKSIM;
+            } else if (strcmp(optarg, "startup") == 0) {
+                opts.workload = WORKLOAD_STARTUP;
+            } else if (strcmp(optarg, "bandwidth") == 0) {
+                opts.workload = WORKLOAD_BANDWIDTH;
+            } else {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'b':
+            opts.blockSize = atoi(optarg);
+            if (opts.blockSize <= 0) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'B':
+            opts.payload = atoi(optarg) * 1024;
+            if (opts.payload < 64 * 1024 || opts.payload > 16 * 1024 * 1024) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'i':
+            opts.iterations = atoi(optarg);
+            if (opts.iterations <= 0) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'r':
+            opts.root = atoi(optarg);
+            break;
+        case 'k':
+            opts.walkers = atoi(optarg);
+            if (opts.walkers <= 0) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 's':
+            opts.steps = strtoull(optarg, NULL, 10);
+            break;
+        case 'g':
+            opts.generic = 1;
+            break;
+        case 't':
+            opts.tokens = atoi(optarg);
+            if (opts.tokens <= 0) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'H':
+            if (strtoll(optarg, &end, 10) <= 0 || *end != '\0') {
+                usage(argv[0]);
+                return 1;
+            }
+            opts.hops = strtoull(optarg, NULL, 10);
+            break;
+        case 'd': {
+            double seconds = strtod(optarg, &end);
+            if (end == optarg || *end != '\0' || !(seconds > 0 && seconds < 1e9)) { // Also rejects NaN
+                usage(argv[0]);
+                return 1;
+            }
+            opts.duration = (uint64_t)(seconds * 1e9);
+            break;
+        }
+        case 'p':
+            if (strcmp(optarg, "auto") == 0) {
+                opts.adaptiveSpin = 1;
+            } else {
+                opts.spin = (uint64_t)(atof(optarg) * 1e3);
+            }
+            break;
+        case 'L':
+            opts.wakeup = 1;
+            break;
+        case 'C':
+            opts.counters = 1;
+            break;
+        case 'P':
+            opts.profile = 1;
+            break;
+        case 'S':
+            if (strcmp(optarg, "scan") == 0) {
+                opts.spawn = SPAWN_SCAN;
+            } else if (strcmp(optarg, "compact") == 0) {
+                opts.spawn = SPAWN_COMPACT;
+            } else {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'T':
+            if (strcmp(optarg, "pipe") == 0) {
+                opts.transport = EDGES_PIPE;
+            } else if (strcmp(optarg, "futex") == 0) {
+                opts.transport = EDGES_FUTEX;
+            } else if (strcmp(optarg, "eventfd") == 0) {
+                opts.transport = EDGES_EVENTFD;
+            } else {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'F':
+            if (strcmp(optarg, "wakeup") == 0) {
+                opts.flush = FLUSH_WAKEUP;
+            } else if (strcmp(optarg, "immediate") == 0) {
+                opts.flush = FLUSH_IMMEDIATE;
+            } else if (strncmp(optarg, "count:", 6) == 0 && atoi(optarg + 6) > 0) {
+                opts.flush = FLUSH_COUNT;
+                opts.flushThreshold = atoi(optarg + 6);
+            } else if (strncmp(optarg, "size:", 5) == 0 && atoi(optarg + 5) > 0) {
+                opts.flush = FLUSH_SIZE;
+                opts.flushThreshold = atoi(optarg + 5);
+            } else {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'c':
+            opts.credits = atoi(optarg);
+            if (opts.credits <= 0 || opts.credits > MAX_CREDITS) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'R':
+            if (strcmp(optarg, "random") == 0) {
+                opts.route = ROUTE_RANDOM;
+            } else if (strcmp(optarg, "p2c") == 0) {
+                opts.route = ROUTE_P2C;
+            } else {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'W':
+            opts.watchdog = (uint64_t)(atof(optarg) * 1e6);
+            break;
+        case 'f':
+            if (addFault(optarg) == -1) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (optind != argc - 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (opts.workload == WORKLOAD_FFT && (opts.blockSize & (opts.blockSize - 1)) != 0) {
+        printf("the fft workload needs a block size that is a power of two\n");
+        return 1;
+    }
+
+    if (opts.transport != EDGES_PIPE && opts.workload != WORKLOAD_TOKEN && opts.workload != WORKLOAD_WALKSIM) {
+        printf("only the token walk runs over mailboxes, the other workloads need pipes\n");
+        return 1;
+    }
+
+    if ((opts.flush != FLUSH_WAKEUP || opts.credits) && opts.transport != EDGES_PIPE) {
+        printf("--flush and --credits apply to the frames written to pipes, mailboxes take one token at a time\n");
+        return 1;
+    }
+
+    if (opts.route == ROUTE_P2C && opts.transport == EDGES_PIPE && !opts.credits) {
+        printf("--route p2c needs --credits on pipes, the sender cannot see what its neighbours have not read\n");
         return 1;
     }
 
     printf("process PID : %d\n", getpid());
 
-    int n = atoi(argv[1]);
+    int n = atoi(argv[optind]);
+
+    if (opts.workload == WORKLOAD_WALKSIM) {
+        if (n < 1 || n > MAX_SIMULATED_DIMENSION) {
+            printf("n must be between 1 and %d\n", MAX_SIMULATED_DIMENSION);
+            return 1;
+        }
+        simulateWalkers(n, opts.walkers, opts.steps);
+        exit(0);
+    }
+
+    if (n < 1 || n > MAX_DIMENSION) {
+        printf("n must be between 1 and %d\n", MAX_DIMENSION);
+        return 1;
+    }
+    if (opts.root < 0 || opts.root >= (1<<n)) {
+        printf("root must be between 0 and %d\n", (1<<n) - 1);
+        return 1;
+    }
+
+    if (opts.workload == WORKLOAD_STARTUP) {
+        // One cube per dimension, for the start-up cost curve
+        for (int d = 1; d <= n; d++) {
+            setupControl(d);
+            createPipes(d);
+            createSharedStats(d);
+            createProcesses(d);
+            closeControl();
+        }
+        exit(0);
+    }
 
-    createPipes(n);
+    setupControl(n);
+
+    if (opts.transport == EDGES_PIPE)
+        createPipes(n);
+    else
+        createMailboxes(n);
+
+    createSharedStats(n);
 
     createProcesses(n);
 
+    closeControl();
+
     exit(0);
 
 }
\ No newline at end of file
@@ -0,0 +1,405 @@
+#define _GNU_SOURCE // sched_getcpu()
+#include "profile.h"
+#include <sched.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+
+struct nodeProfile *nodeProfiles = NULL;
+struct nodeCounters *nodeCounters = NULL;
+struct wakeupEdge *wakeupEdges = NULL; // edge node * n + dim, indexed like the pipes
+
+/**
+ * Wake-up latencies of the whole cube, updated atomically by the receivers.
+ */
+struct wakeupProbe {
+    uint64_t samples[MAX_DIMENSION];
+    uint64_t totalNs[MAX_DIMENSION];
+    uint64_t histogram[MAX_DIMENSION][PROFILE_BUCKETS]; // bucket b counts [2^(b-1), 2^b) ns
+    uint64_t queued;   // tokens already waiting when the receiver called select()
+    int cpus;          // size of the CPU pair matrices
+    uint64_t pairs[];  // samples then total ns, cpus * cpus each, indexed sender * cpus + receiver
+};
+
+static struct wakeupProbe *wakeupProbe = NULL;
+static size_t wakeupSize = 0, wakeupEdgesSize = 0;
+
+static const char *phaseNames[NB_PHASES] = { "wait", "read", "bookkeeping", "logging", "choose", "write" };
+static size_t profilesSize = 0;
+static double cyclesPerNs = 1;
+
+static const struct {
+    const char *name;
+    uint32_t type;
+    uint64_t config;
+} counterEvents[NB_COUNTERS] = {
+    { "context_switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES },
+    { "migrations", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS },
+    { "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { "cache_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES }
+};
+
+
+/**
+ * Maps the per-node profiles, counters and wake-up probe shared by the parent and all
+ * children, and measures the frequency of the time stamp counter against the monotonic clock.
+ * 
+ * param n The dimension of the hypercube.
+ */
+void createProfiles(int n)
+{
+    if (opts.counters)
+    {
+        nodeCounters = mmap(NULL, (1 << n) * sizeof(struct nodeCounters), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (nodeCounters == MAP_FAILED)
+        {
+            perror("mmap");
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (opts.wakeup)
+    {
+        int cpus = sysconf(_SC_NPROCESSORS_CONF);
+        if (cpus < 1 || cpus > 256)
+            cpus = 256; // larger machines fold their CPUs onto the first 256
+
+        wakeupEdgesSize = ((size_t)n << n) * sizeof(struct wakeupEdge);
+        wakeupEdges = mmap(NULL, wakeupEdgesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        wakeupSize = sizeof(struct wakeupProbe) + 2 * (size_t)cpus * cpus * sizeof(uint64_t);
+        wakeupProbe = mmap(NULL, wakeupSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (wakeupEdges == MAP_FAILED || wakeupProbe == MAP_FAILED)
+        {
+            perror("mmap");
+            exit(EXIT_FAILURE);
+        }
+        wakeupProbe->cpus = cpus;
+    }
+    if (!opts.profile)
+        return;
+
+    profilesSize = (1 << n) * sizeof(struct nodeProfile);
+    nodeProfiles = mmap(NULL, profilesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (nodeProfiles == MAP_FAILED)
+    {
+        perror("mmap");
+        exit(EXIT_FAILURE);
+    }
+
+    uint64_t startNs = monotonicNs(), start = readCycles();
+    while (monotonicNs() - startNs < 10000000)
+        ;
+    cyclesPerNs = (double)(readCycles() - start) / (monotonicNs() - startNs);
+}
+
+
+/**
+ * Returns the upper bound of the bucket holding the given fraction of a histogram.
+ */
+uint64_t percentile(const uint64_t *histogram, uint64_t count, double fraction)
+{
+    uint64_t seen = 0;
+
+    if (count == 0)
+        return 0;
+    for (int b = 0; b < PROFILE_BUCKETS; b++)
+    {
+        seen += histogram[b];
+        if (seen > 0 && seen >= fraction * count)
+            return 1ull << b;
+    }
+    return 1ull << (PROFILE_BUCKETS - 1);
+}
+
+
+/**
+ * Writes the profile of a node to its file: for each phase, the calls, the mean and the
+ * non-empty buckets of the histogram as upper bound in cycles:count.
+ * 
+ * param file The file of the node.
+ * param profile The profile of the node.
+ */
+void writeProfile(FILE *file, struct nodeProfile *profile)
+{
+    for (int p = 0; p < NB_PHASES; p++)
+    {
+        struct phaseStats *phase = &profile->phases[p];
+
+        fprintf(file, "Profile %s: calls: %llu, mean_cycles: %.0f, histogram:", phaseNames[p],
+                (unsigned long long)phase->count, phase->count ? (double)phase->cycles / phase->count : 0);
+        for (int b = 0; b < PROFILE_BUCKETS; b++)
+            if (phase->histogram[b])
+                fprintf(file, " %llu:%llu", 1ull << b, (unsigned long long)phase->histogram[b]);
+        fprintf(file, "\n");
+    }
+}
+
+
+/**
+ * Prints the phases of a hop over the whole cube: calls, mean time, median and 99th
+ * percentile (upper bounds of power-of-two buckets) and share of the time of the nodes.
+ * 
+ * param n The dimension of the hypercube.
+ */
+void reportProfile(int n)
+{
+    struct phaseStats total[NB_PHASES] = {0};
+    uint64_t allCycles = 0;
+
+    for (int i = 0; i < 1 << n; i++)
+    {
+        for (int p = 0; p < NB_PHASES; p++)
+        {
+            total[p].count += nodeProfiles[i].phases[p].count;
+            total[p].cycles += nodeProfiles[i].phases[p].cycles;
+            for (int b = 0; b < PROFILE_BUCKETS; b++)
+                total[p].histogram[b] += nodeProfiles[i].phases[p].histogram[b];
+        }
+    }
+    for (int p = 0; p < NB_PHASES; p++)
+        allCycles += total[p].cycles;
+
+    for (int p = 0; p < NB_PHASES; p++)
+    {
+        double mean = total[p].count ? (double)total[p].cycles / total[p].count : 0;
+        printf("profile phase=%s calls=%llu mean_cycles=%.0f mean_ns=%.0f p50_cycles=%llu p99_cycles=%llu share=%.1f%%\n",
+               phaseNames[p], (unsigned long long)total[p].count, mean, mean / cyclesPerNs,
+               (unsigned long long)percentile(total[p].histogram, total[p].count, 0.5),
+               (unsigned long long)percentile(total[p].histogram, total[p].count, 0.99),
+               allCycles ? 100.0 * total[p].cycles / allCycles : 0);
+    }
+}
+
+void freeProfiles()
+{
+    if (nodeProfiles != NULL)
+        munmap(nodeProfiles, profilesSize);
+    nodeProfiles = NULL;
+    if (nodeCounters != NULL)
+        munmap(nodeCounters, nbProcesses * sizeof(struct nodeCounters));
+    nodeCounters = NULL;
+    if (wakeupEdges != NULL)
+    {
+        munmap(wakeupEdges, wakeupEdgesSize);
+        munmap(wakeupProbe, wakeupSize);
+    }
+    wakeupEdges = NULL;
+    wakeupProbe = NULL;
+}
+
+
+/**
+ * Opens the perf_event counters of the calling node and starts them.
+ * 
+ * Each counter follows the node only, on any CPU. Hardware counters count user space
+ * only, which unprivileged processes are allowed to; a counter the kernel or the machine
+ * does not provide, e.g. hardware counters in most virtual machines, is left closed (-1).
+ * 
+ * param fds The descriptors of the NB_COUNTERS counters, filled in.
+ */
+void openCounters(int *fds)
+{
+    for (int c = 0; c < NB_COUNTERS; c++)
+    {
+        struct perf_event_attr attr;
+
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = counterEvents[c].type;
+        attr.config = counterEvents[c].config;
+        attr.disabled = 1;
+        attr.exclude_kernel = attr.type == PERF_TYPE_HARDWARE;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        fds[c] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+
+    for (int c = 0; c < NB_COUNTERS; c++)
+        if (fds[c] != -1)
+            ioctl(fds[c], PERF_EVENT_IOC_ENABLE, 0);
+}
+
+
+/**
+ * Stops the counters of a node and stores their values in its shared entry. A counter
+ * that shared the hardware with others is scaled up to the whole time it was enabled.
+ * 
+ * param id The ID of the current process.
+ * param fds The descriptors returned by openCounters().
+ */
+void closeCounters(int id, int *fds)
+{
+    for (int c = 0; c < NB_COUNTERS; c++)
+        if (fds[c] != -1)
+            ioctl(fds[c], PERF_EVENT_IOC_DISABLE, 0);
+
+    for (int c = 0; c < NB_COUNTERS; c++)
+    {
+        uint64_t value[3]; // value, time enabled, time running
+
+        if (fds[c] == -1)
+            continue;
+        if (read(fds[c], value, sizeof(value)) == sizeof(value))
+        {
+            nodeCounters[id].values[c] = value[2] > 0 && value[2] < value[1] ? (uint64_t)((double)value[0] * value[1] / value[2]) : value[0];
+            nodeCounters[id].opened |= 1u << c;
+        }
+        close(fds[c]);
+    }
+}
+
+
+/**
+ * Prints the counters of the cube: total, mean per node, largest node and, when the
+ * workload counts hops, per hop, plus instructions per cycle. One row per node goes
+ * to <n>/counters.txt.
+ * 
+ * param n The dimension of the hypercube.
+ */
+void reportCounters(int n)
+{
+    uint64_t total[NB_COUNTERS] = {0}, max[NB_COUNTERS] = {0}, hops = 0;
+    uint32_t opened = ~0u;
+    char filename[128];
+
+    snprintf(filename, sizeof(filename), "%d/counters.txt", n);
+    FILE *file = fopen(filename, "w");
+    if (file == NULL)
+    {
+        perror("fopen");
+        exit(EXIT_FAILURE);
+    }
+
+    fprintf(file, "node");
+    for (int c = 0; c < NB_COUNTERS; c++)
+        fprintf(file, " %s", counterEvents[c].name);
+    fprintf(file, " hops\n");
+
+    for (int i = 0; i < 1 << n; i++)
+    {
+        char *binaryString = intToBinary(i, n);
+
+        opened &= nodeCounters[i].opened;
+        fprintf(file, "%s", binaryString);
+        for (int c = 0; c < NB_COUNTERS; c++)
+        {
+            total[c] += nodeCounters[i].values[c];
+            if (nodeCounters[i].values[c] > max[c])
+                max[c] = nodeCounters[i].values[c];
+            if (nodeCounters[i].opened & (1u << c))
+                fprintf(file, " %llu", (unsigned long long)nodeCounters[i].values[c]);
+            else
+                fprintf(file, " -");
+        }
+        fprintf(file, " %llu\n", (unsigned long long)nodeStats[i].items);
+        hops += nodeStats[i].items;
+        free(binaryString);
+    }
+    fclose(file);
+
+    for (int c = 0; c < NB_COUNTERS; c++)
+    {
+        printf("counters n=%d counter=%s", n, counterEvents[c].name);
+        if (!(opened & (1u << c)))
+        {
+            printf(" unavailable\n");
+            continue;
+        }
+        printf(" total=%llu per_node=%.1f max_node=%llu", (unsigned long long)total[c],
+               (double)total[c] / (1 << n), (unsigned long long)max[c]);
+        if (opts.workload == WORKLOAD_TOKEN && hops > 0)
+            printf(" per_hop=%.3f", (double)total[c] / hops);
+        printf("\n");
+    }
+
+    if ((opened & (1u << COUNTER_CYCLES)) && (opened & (1u << COUNTER_INSTRUCTIONS)) && total[COUNTER_CYCLES] > 0)
+        printf("counters n=%d ipc=%.2f\n", n, (double)total[COUNTER_INSTRUCTIONS] / total[COUNTER_CYCLES]);
+}
+
+
+/**
+ * Stamps a token about to be written to node across dimension dim.
+ * 
+ * param node The receiver.
+ * param n The dimension of the hypercube.
+ * param dim The dimension of the edge.
+ */
+void probeSend(int node, int n, int dim)
+{
+    struct wakeupEdge *edge = &wakeupEdges[node * n + dim];
+
+    edge->cpu = sched_getcpu();
+    __atomic_store_n(&edge->sentNs, monotonicNs(), __ATOMIC_RELEASE);
+}
+
+
+/**
+ * Records the wake-up latency of a token found on an edge after select() returned.
+ * 
+ * The latency runs from the send to the return of select(). A token sent before the
+ * receiver went to sleep did not wake it up and is only counted as queued. With several
+ * tokens on the edge, the stamp is that of the last one sent.
+ * 
+ * param id The ID of the receiver.
+ * param n The dimension of the hypercube.
+ * param dim The dimension of the edge.
+ * param sleptNs The monotonic time at which the receiver called select().
+ * param wokeNs The monotonic time at which select() returned.
+ */
+void probeWake(int id, int n, int dim, uint64_t sleptNs, uint64_t wokeNs)
+{
+    struct wakeupEdge *edge = &wakeupEdges[id * n + dim];
+    uint64_t sentNs = __atomic_exchange_n(&edge->sentNs, 0, __ATOMIC_ACQUIRE);
+
+    if (sentNs == 0)
+        return; // TOKEN_STOP, or a token already stamped
+    if (sentNs < sleptNs || sentNs > wokeNs)
+    {
+        __atomic_add_fetch(&wakeupProbe->queued, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    uint64_t ns = wokeNs - sentNs;
+    int bucket = ns == 0 ? 0 : 64 - __builtin_clzll(ns);
+    int cpus = wakeupProbe->cpus;
+    int pair = (edge->cpu % cpus) * cpus + sched_getcpu() % cpus;
+
+    __atomic_add_fetch(&wakeupProbe->samples[dim], 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&wakeupProbe->totalNs[dim], ns, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&wakeupProbe->histogram[dim][bucket < PROFILE_BUCKETS ? bucket : PROFILE_BUCKETS - 1], 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&wakeupProbe->pairs[pair], 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&wakeupProbe->pairs[cpus * cpus + pair], ns, __ATOMIC_RELAXED);
+}
+
+
+/**
+ * Prints the wake-up latency distribution of each dimension, then the mean latency of
+ * each pair of sender and receiver CPUs that was seen.
+ * 
+ * param n The dimension of the hypercube.
+ */
+void reportWakeup(int n)
+{
+    int cpus = wakeupProbe->cpus;
+
+    for (int dim = 0; dim < n; dim++)
+    {
+        uint64_t samples = wakeupProbe->samples[dim];
+
+        printf("wakeup n=%d dim=%d samples=%llu mean_us=%.2f p50_us=%.2f p90_us=%.2f p99_us=%.2f\n", n, dim,
+               (unsigned long long)samples, samples ? wakeupProbe->totalNs[dim] / 1e3 / samples : 0,
+               percentile(wakeupProbe->histogram[dim], samples, 0.5) / 1e3,
+               percentile(wakeupProbe->histogram[dim], samples, 0.9) / 1e3,
+               percentile(wakeupProbe->histogram[dim], samples, 0.99) / 1e3);
+    }
+    printf("wakeup n=%d queued=%llu\n", n, (unsigned long long)wakeupProbe->queued);
+
+    for (int pair = 0; pair < cpus * cpus; pair++)
+    {
+        uint64_t samples = wakeupProbe->pairs[pair];
+
+        if (samples)
+            printf("wakeup n=%d cpus=%d->%d samples=%llu mean_us=%.2f\n", n, pair / cpus, pair % cpus,
+                   (unsigned long long)samples, wakeupProbe->pairs[cpus * cpus + pair] / 1e3 / samples);
+    }
+}
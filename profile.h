@@ -0,0 +1,122 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "hypercube.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#define PROFILE_BUCKETS LATENCY_BUCKETS // bucket b counts the phases that took [2^(b-1), 2^b) cycles
+
+/**
+ * The phases of a hop in passToken(), in the order they happen.
+ */
+enum phase {
+    PHASE_WAIT,        // select(), and rebuilding its descriptor set
+    PHASE_READ,        // read() and decoding of the frames of an edge
+    PHASE_BOOKKEEPING, // increment, statistics, end of run checks
+    PHASE_LOGGING,     // fprintf(), fflush() and printf() of the hop
+    PHASE_CHOOSE,      // choice of the next neighbour
+    PHASE_WRITE,       // encoding of the frame, write() of the batches
+    NB_PHASES
+};
+
+struct phaseStats {
+    uint64_t count;
+    uint64_t cycles;
+    uint64_t histogram[PROFILE_BUCKETS];
+};
+
+/**
+ * Time spent by a node in each phase, in a page shared with the parent.
+ */
+struct nodeProfile {
+    struct phaseStats phases[NB_PHASES];
+};
+
+/**
+ * The perf_event counters a node opens for itself with --counters.
+ */
+enum counter {
+    COUNTER_CONTEXT_SWITCHES,
+    COUNTER_MIGRATIONS,
+    COUNTER_CYCLES,
+    COUNTER_INSTRUCTIONS,
+    COUNTER_CACHE_MISSES,
+    NB_COUNTERS
+};
+
+/**
+ * Counter values of a node, in a page shared with the parent.
+ */
+struct nodeCounters {
+    uint64_t values[NB_COUNTERS]; // scaled when the kernel multiplexed the counter
+    uint32_t opened;              // bit c set if counter c could be opened
+};
+
+/**
+ * Send time of the last token written to an edge, for the wake-up probe.
+ */
+struct wakeupEdge {
+    uint64_t sentNs; // monotonic time, 0 once the receiver has taken it
+    int cpu;         // CPU the sender ran on
+};
+
+extern struct nodeProfile *nodeProfiles;
+extern struct nodeCounters *nodeCounters;
+extern struct wakeupEdge *wakeupEdges;
+
+/**
+ * Reads the time stamp counter, or the monotonic clock where there is none.
+ */
+static inline uint64_t readCycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return monotonicNs();
+#endif
+}
+
+/**
+ * Closes a phase: the cycles since mark are added to the phase, and mark moves to now.
+ * 
+ * param profile The profile of the node.
+ * param phase The phase that just ended.
+ * param mark The end of the previous phase.
+ */
+static inline void recordPhase(struct nodeProfile *profile, enum phase phase, uint64_t *mark)
+{
+    uint64_t now = readCycles();
+    uint64_t cycles = now - *mark;
+    int bucket = cycles == 0 ? 0 : 64 - __builtin_clzll(cycles);
+
+    *mark = now;
+    profile->phases[phase].count++;
+    profile->phases[phase].cycles += cycles;
+    profile->phases[phase].histogram[bucket < PROFILE_BUCKETS ? bucket : PROFILE_BUCKETS - 1]++;
+}
+
+void createProfiles(int n);
+
+uint64_t percentile(const uint64_t *histogram, uint64_t count, double fraction);
+
+void writeProfile(FILE *file, struct nodeProfile *profile);
+
+void reportProfile(int n);
+
+void freeProfiles();
+
+void openCounters(int *fds);
+
+void closeCounters(int id, int *fds);
+
+void reportCounters(int n);
+
+void probeSend(int node, int n, int dim);
+
+void probeWake(int id, int n, int dim, uint64_t sleptNs, uint64_t wokeNs);
+
+void reportWakeup(int n);
+
+#endif //PROFILE_H
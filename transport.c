@@ -0,0 +1,532 @@
+#include "transport.h"
+#include <sched.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+
+/**
+ * Lock and condition a node of the threaded transport sleeps on.
+ */
+struct sleeper {
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+};
+
+static int (*edgePipes)[2] = NULL;   // pipe node * n + dim carries the messages sent to node across dim
+static int (*edgeSockets)[2] = NULL; // socketpair lower * n + dim joins lower to lower ^ (1 << dim)
+static struct ring *rings = NULL;    // ring node * n + dim of edges.c, indexed like edgePipes
+static size_t ringsSize = 0;
+static int *eventfds = NULL;         // eventfd doorbell of each node
+static struct doorbell *doorbells = NULL; // futex doorbell of each node
+static struct sleeper *sleepers = NULL;
+
+
+static int createRings(int n)
+{
+    ringsSize = ((size_t)n << n) * sizeof(struct ring);
+    rings = mapShared(ringsSize);
+    return rings == NULL ? -1 : 0;
+}
+
+
+static void destroyRings()
+{
+    if (rings != NULL)
+        munmap(rings, ringsSize);
+    rings = NULL;
+}
+
+
+/**
+ * Takes the next message sent to a node from any of its inbound rings.
+ *
+ * return The dimension the message came from, -1 if every ring is empty.
+ */
+static int pollRings(int id, int n, struct message *message)
+{
+    for (int dim = 0; dim < n; dim++)
+        if (ringPop(&rings[id * n + dim], message) == 0)
+            return dim;
+    return -1;
+}
+
+
+/**
+ * The node whose rings waitDoorbell() watches.
+ */
+struct watchedRings {
+    int id, n;
+};
+
+/**
+ * return 1 if one of the inbound rings of the node holds a message.
+ */
+static int ringsPending(void *context)
+{
+    struct watchedRings *node = context;
+
+    for (int dim = 0; dim < node->n; dim++)
+        if (ringPending(&rings[node->id * node->n + dim]))
+            return 1;
+    return 0;
+}
+
+
+/**
+ * Pipes, one per directed edge, as in passToken(), but watched with poll() and carrying
+ * bare messages: neither the select() nor the frames and batches of the token walk,
+ * whose own figures come from the summary line of test. Hence the name pipe-poll.
+ */
+static int pipeCreate(int n)
+{
+    int count = n << n;
+
+    edgePipes = malloc(count * sizeof(*edgePipes));
+    if (edgePipes == NULL)
+        return -1;
+    for (int i = 0; i < count; i++)
+    {
+        if (pipe(edgePipes[i]) == -1)
+        {
+            int error = errno;
+            while (i-- > 0)
+            {
+                close(edgePipes[i][0]);
+                close(edgePipes[i][1]);
+            }
+            free(edgePipes);
+            edgePipes = NULL;
+            errno = error;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Keeps the read ends of the n pipes of a node and the write ends of the pipes of its
+ * neighbours. The entries of the other pipes are left stale in the node's copy of
+ * edgePipes, it never looks at them.
+ */
+static void pipeWire(int id, int n)
+{
+    int *kept[2 * MAX_DIMENSION];
+
+    for (int dim = 0; dim < n; dim++)
+    {
+        kept[2 * dim] = &edgePipes[id * n + dim][0];
+        kept[2 * dim + 1] = &edgePipes[(id ^ (1 << dim)) * n + dim][1];
+    }
+    keepDescriptors(kept, 2 * n, edgePipes[(n << n) - 1][1] + 1); // The last pipe holds the highest descriptors
+}
+
+static void pipeSend(int id, int n, int dim, const struct message *message)
+{
+    // A neighbour that has already left only costs an EPIPE
+    if (write(edgePipes[(id ^ (1 << dim)) * n + dim][1], message, sizeof(*message)) == -1 && errno != EPIPE)
+    {
+        perror("write failed");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static int pipeReceive(int id, int n, struct message *message)
+{
+    struct pollfd fds[MAX_DIMENSION];
+
+    for (int dim = 0; dim < n; dim++)
+    {
+        fds[dim].fd = edgePipes[id * n + dim][0];
+        fds[dim].events = POLLIN;
+    }
+
+    for (;;)
+    {
+        if (poll(fds, n, -1) == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("poll");
+            exit(EXIT_FAILURE);
+        }
+
+        for (int dim = 0; dim < n; dim++)
+        {
+            if (fds[dim].revents & POLLIN)
+            {
+                if (read(fds[dim].fd, message, sizeof(*message)) != sizeof(*message))
+                {
+                    perror("pipe read fail");
+                    exit(EXIT_FAILURE);
+                }
+                return dim;
+            }
+        }
+    }
+}
+
+static void pipeDestroy(int n)
+{
+    for (int i = 0; i < n << n; i++)
+    {
+        close(edgePipes[i][0]);
+        close(edgePipes[i][1]);
+    }
+    free(edgePipes);
+    edgePipes = NULL;
+}
+
+
+/**
+ * Unix sequenced-packet socketpairs, one per undirected edge, so half as many
+ * descriptors as pipes, and poll() over the n sockets of a node.
+ */
+static int socketFd(int id, int n, int dim)
+{
+    return edgeSockets[(id & ~(1 << dim)) * n + dim][(id >> dim) & 1];
+}
+
+static int socketCreate(int n)
+{
+    edgeSockets = malloc((n << n) * sizeof(*edgeSockets));
+    if (edgeSockets == NULL)
+        return -1;
+    for (int i = 0; i < n << n; i++)
+    {
+        int node = i / n, dim = i % n;
+
+        edgeSockets[i][0] = edgeSockets[i][1] = -1;
+        if (node & (1 << dim))
+            continue; // the lower node of the edge holds its socketpair
+
+        if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, edgeSockets[i]) == -1)
+        {
+            int error = errno;
+            while (i-- > 0)
+            {
+                if (edgeSockets[i][0] != -1)
+                {
+                    close(edgeSockets[i][0]);
+                    close(edgeSockets[i][1]);
+                }
+            }
+            free(edgeSockets);
+            edgeSockets = NULL;
+            errno = error;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Keeps the node's end of the socketpair of each of its n edges.
+ */
+static void socketWire(int id, int n)
+{
+    int *kept[MAX_DIMENSION];
+    int above = 0;
+
+    for (int i = 0; i < n << n; i++)
+        if (edgeSockets[i][1] >= above)
+            above = edgeSockets[i][1] + 1;
+
+    for (int dim = 0; dim < n; dim++)
+        kept[dim] = &edgeSockets[(id & ~(1 << dim)) * n + dim][(id >> dim) & 1];
+    keepDescriptors(kept, n, above);
+}
+
+static void socketSend(int id, int n, int dim, const struct message *message)
+{
+    if (send(socketFd(id, n, dim), message, sizeof(*message), MSG_NOSIGNAL) == -1 && errno != EPIPE)
+    {
+        perror("send");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static int socketReceive(int id, int n, struct message *message)
+{
+    struct pollfd fds[MAX_DIMENSION];
+
+    for (int dim = 0; dim < n; dim++)
+    {
+        fds[dim].fd = socketFd(id, n, dim);
+        fds[dim].events = POLLIN;
+    }
+
+    for (;;)
+    {
+        if (poll(fds, n, -1) == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("poll");
+            exit(EXIT_FAILURE);
+        }
+
+        for (int dim = 0; dim < n; dim++)
+        {
+            if (fds[dim].revents & POLLIN)
+            {
+                if (recv(fds[dim].fd, message, sizeof(*message), 0) != sizeof(*message))
+                {
+                    perror("recv");
+                    exit(EXIT_FAILURE);
+                }
+                return dim;
+            }
+        }
+    }
+}
+
+static void socketDestroy(int n)
+{
+    for (int i = 0; i < n << n; i++)
+    {
+        if (edgeSockets[i][0] != -1)
+        {
+            close(edgeSockets[i][0]);
+            close(edgeSockets[i][1]);
+        }
+    }
+    free(edgeSockets);
+    edgeSockets = NULL;
+}
+
+
+/**
+ * Shared-memory rings, one per directed edge. A node without messages yields the
+ * processor instead of sleeping, so it never waits for a wake-up but burns CPU
+ * time when the cube has more nodes than cores.
+ */
+static int shmReceive(int id, int n, struct message *message)
+{
+    int dim;
+
+    while ((dim = pollRings(id, n, message)) == -1)
+        sched_yield();
+    return dim;
+}
+
+static void shmDestroy(int n)
+{
+    (void)n;
+    destroyRings();
+}
+
+/**
+ * Appends a message to the ring of the neighbour, yielding the processor while the ring
+ * is full.
+ */
+static void shmSend(int id, int n, int dim, const struct message *message)
+{
+    while (ringPush(&rings[(id ^ (1 << dim)) * n + dim], message) == -1)
+        sched_yield();
+}
+
+
+/**
+ * Shared-memory rings as mailboxes and one eventfd per node as a doorbell: the
+ * sender rings the doorbell after each message, and a node with empty mailboxes
+ * sleeps in read() on a single descriptor. The rings and the doorbells are those
+ * of edges.c, which the token walk uses for --transport eventfd and futex.
+ */
+static int eventfdCreate(int n)
+{
+    if (createRings(n) == -1)
+        return -1;
+
+    eventfds = malloc((1 << n) * sizeof(int));
+    if (eventfds == NULL)
+    {
+        destroyRings();
+        return -1;
+    }
+    for (int id = 0; id < 1 << n; id++)
+    {
+        eventfds[id] = eventfd(0, 0);
+        if (eventfds[id] == -1)
+        {
+            int error = errno;
+            while (id-- > 0)
+                close(eventfds[id]);
+            free(eventfds);
+            eventfds = NULL;
+            destroyRings();
+            errno = error;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Keeps the node's own doorbell, which it sleeps on, and the doorbells of its n
+ * neighbours, which it rings.
+ */
+static void eventfdWire(int id, int n)
+{
+    int *kept[MAX_DIMENSION + 1];
+
+    kept[0] = &eventfds[id];
+    for (int dim = 0; dim < n; dim++)
+        kept[dim + 1] = &eventfds[id ^ (1 << dim)];
+    keepDescriptors(kept, n + 1, eventfds[(1 << n) - 1] + 1);
+}
+
+static void eventfdSend(int id, int n, int dim, const struct message *message)
+{
+    shmSend(id, n, dim, message);
+    ringDoorbell(NULL, eventfds[id ^ (1 << dim)]);
+}
+
+static int eventfdReceive(int id, int n, struct message *message)
+{
+    struct watchedRings node = { id, n };
+    int dim;
+
+    while ((dim = pollRings(id, n, message)) == -1)
+        waitDoorbell(NULL, eventfds[id], ringsPending, &node, -1);
+    return dim;
+}
+
+static void eventfdDestroy(int n)
+{
+    for (int id = 0; id < 1 << n; id++)
+        close(eventfds[id]);
+    free(eventfds);
+    eventfds = NULL;
+    destroyRings();
+}
+
+
+/**
+ * Shared-memory rings as mailboxes and one futex word per node. The sender bumps the
+ * word after each message and calls FUTEX_WAKE only when the receiver said it sleeps,
+ * so a node that is busy costs its senders no system call.
+ */
+static int futexCreate(int n)
+{
+    if (createRings(n) == -1)
+        return -1;
+
+    doorbells = mapShared((1 << n) * sizeof(struct doorbell));
+    if (doorbells == NULL)
+    {
+        destroyRings();
+        return -1;
+    }
+    return 0;
+}
+
+static void futexSend(int id, int n, int dim, const struct message *message)
+{
+    shmSend(id, n, dim, message);
+    ringDoorbell(&doorbells[id ^ (1 << dim)], -1);
+}
+
+static int futexReceive(int id, int n, struct message *message)
+{
+    struct watchedRings node = { id, n };
+    int dim;
+
+    while ((dim = pollRings(id, n, message)) == -1)
+        waitDoorbell(&doorbells[id], -1, ringsPending, &node, -1);
+    return dim;
+}
+
+static void futexDestroy(int n)
+{
+    munmap(doorbells, (1 << n) * sizeof(struct doorbell));
+    doorbells = NULL;
+    destroyRings();
+}
+
+
+/**
+ * Nodes as threads of a single process, exchanging messages through the rings
+ * and sleeping on a condition variable when their rings are empty.
+ */
+static int threadCreate(int n)
+{
+    if (createRings(n) == -1)
+        return -1;
+
+    sleepers = malloc((1 << n) * sizeof(struct sleeper));
+    if (sleepers == NULL)
+    {
+        destroyRings();
+        return -1;
+    }
+    for (int id = 0; id < 1 << n; id++)
+    {
+        pthread_mutex_init(&sleepers[id].lock, NULL);
+        pthread_cond_init(&sleepers[id].wake, NULL);
+    }
+    return 0;
+}
+
+static void threadSend(int id, int n, int dim, const struct message *message)
+{
+    struct sleeper *sleeper = &sleepers[id ^ (1 << dim)];
+
+    shmSend(id, n, dim, message);
+    pthread_mutex_lock(&sleeper->lock);
+    pthread_cond_signal(&sleeper->wake);
+    pthread_mutex_unlock(&sleeper->lock);
+}
+
+static int threadReceive(int id, int n, struct message *message)
+{
+    int dim = pollRings(id, n, message);
+
+    if (dim == -1)
+    {
+        // Checked again under the lock, which the sender takes to signal
+        pthread_mutex_lock(&sleepers[id].lock);
+        while ((dim = pollRings(id, n, message)) == -1)
+            pthread_cond_wait(&sleepers[id].wake, &sleepers[id].lock);
+        pthread_mutex_unlock(&sleepers[id].lock);
+    }
+    return dim;
+}
+
+static void threadDestroy(int n)
+{
+    for (int id = 0; id < 1 << n; id++)
+    {
+        pthread_mutex_destroy(&sleepers[id].lock);
+        pthread_cond_destroy(&sleepers[id].wake);
+    }
+    free(sleepers);
+    sleepers = NULL;
+    destroyRings();
+}
+
+
+const struct transport transports[] = {
+    { "pipe-poll", 0, pipeCreate, pipeWire, pipeSend, pipeReceive, pipeDestroy },
+    { "socketpair", 0, socketCreate, socketWire, socketSend, socketReceive, socketDestroy },
+    { "shm", 0, createRings, NULL, shmSend, shmReceive, shmDestroy },
+    { "eventfd", 0, eventfdCreate, eventfdWire, eventfdSend, eventfdReceive, eventfdDestroy },
+    { "futex", 0, futexCreate, NULL, futexSend, futexReceive, futexDestroy },
+    { "thread", 1, threadCreate, NULL, threadSend, threadReceive, threadDestroy }
+};
+
+const int nbTransports = sizeof(transports) / sizeof(transports[0]);
+
+
+/**
+ * Looks a transport up by name.
+ *
+ * param name The name of the transport.
+ * return The transport, NULL if there is none with that name.
+ */
+const struct transport *findTransport(const char *name)
+{
+    for (int t = 0; t < nbTransports; t++)
+        if (strcmp(transports[t].name, name) == 0)
+            return &transports[t];
+    return NULL;
+}
@@ -0,0 +1,34 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include "hypercube.h"
+#include "edges.h"
+
+/**
+ * A way to carry messages between neighbour nodes. Node id talks to its
+ * neighbour across dimension dim, i.e. node id ^ (1 << dim).
+ *
+ * create() runs in the parent, before the nodes are forked (or started as threads),
+ * and sets every node up. It returns -1 with errno set when the system lacks the
+ * resources, e.g. file descriptors, for this dimension.
+ *
+ * wire() runs in each forked node before it starts, and closes the descriptors of
+ * the cube the node does not use, so that every node holds only its own edges
+ * whatever the transport. NULL when the transport has no descriptor to prune.
+ */
+struct transport {
+    const char *name;
+    int threaded; // 1 when the nodes are threads of one process, 0 for forked processes
+    int (*create)(int n);
+    void (*wire)(int id, int n);
+    void (*send)(int id, int n, int dim, const struct message *message);
+    int (*receive)(int id, int n, struct message *message); // blocks, returns the dimension
+    void (*destroy)(int n);
+};
+
+extern const struct transport transports[];
+extern const int nbTransports;
+
+const struct transport *findTransport(const char *name);
+
+#endif //TRANSPORT_H
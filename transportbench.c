@@ -0,0 +1,363 @@
+#include "transport.h"
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/resource.h>
+
+/**
+ * Results of one run, in memory shared by the nodes of the run.
+ */
+struct benchRun {
+    volatile int ready;  // nodes attached, the walk starts when all are
+    uint64_t startNs;    // time at which the token was injected
+    uint64_t endNs;      // time at which the token made its last hop
+    int hops;            // hops made by the token
+    uint64_t latencyNs[]; // latency of each hop, from send to receive
+};
+
+/**
+ * Results of a transport for a dimension, one row of the table.
+ */
+struct benchResult {
+    int skipped;
+    int hops;
+    double hopsPerSecond;
+    double p50, p90, p99, max; // hop latency percentiles, microseconds
+    double cpuMs;              // CPU time of all the nodes
+};
+
+static const struct transport *transport;
+static struct benchRun *run;
+static int dimension;
+static int maxHops = 20000;
+static uint64_t maxDurationNs = 1000000000;
+
+
+static uint64_t nowNs()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+
+static uint32_t nextRandom(uint32_t *state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+
+/**
+ * Sends the end of the run to every neighbour.
+ */
+static void broadcastEnd(int id, int n)
+{
+    struct message end = { TOKEN_STOP, 0 };
+
+    for (int dim = 0; dim < n; dim++)
+        transport->send(id, n, dim, &end);
+}
+
+
+/**
+ * The loop of a node: forward the token to a random neighbour and record the latency
+ * of each hop. The node holding the token after --hops hops or --duration seconds
+ * ends the run by flooding TOKEN_STOP; a node leaves after forwarding it once.
+ *
+ * param id The ID of the node.
+ */
+static void nodeLoop(int id)
+{
+    int n = dimension;
+    uint32_t state = 2463534242u + id;
+    struct message message;
+
+    __atomic_add_fetch(&run->ready, 1, __ATOMIC_SEQ_CST);
+
+    if (id == 0)
+    {
+        while (__atomic_load_n(&run->ready, __ATOMIC_SEQ_CST) < 1 << n)
+            usleep(100);
+        run->startNs = nowNs();
+        message.token = 0;
+        message.sentNs = run->startNs;
+        transport->send(id, n, nextRandom(&state) % n, &message);
+    }
+
+    for (;;)
+    {
+        transport->receive(id, n, &message);
+        uint64_t now = nowNs();
+
+        if (message.token == TOKEN_STOP)
+            break;
+
+        run->latencyNs[message.token] = now - message.sentNs;
+        message.token++;
+
+        if (message.token == maxHops || now - run->startNs >= maxDurationNs)
+        {
+            run->hops = message.token;
+            run->endNs = now;
+            break;
+        }
+
+        message.sentNs = nowNs();
+        transport->send(id, n, nextRandom(&state) % n, &message);
+    }
+
+    broadcastEnd(id, n);
+}
+
+
+static void *nodeThread(void *arg)
+{
+    nodeLoop((int)(intptr_t)arg);
+    return NULL;
+}
+
+
+static int compareLatency(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+
+static double cpuMs(int who)
+{
+    struct rusage usage;
+    getrusage(who, &usage);
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1e3 +
+           (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e3;
+}
+
+
+/**
+ * Runs a token walk over a transport on the n-cube.
+ *
+ * Nodes are forked processes, or threads for a threaded transport. The CPU time is
+ * that of the reaped children, or of this process for threads.
+ *
+ * param n The dimension of the hypercube.
+ * return The results of the run.
+ */
+static struct benchResult runTransport(int n)
+{
+    struct benchResult result = {0};
+    size_t runSize = sizeof(struct benchRun) + maxHops * sizeof(uint64_t);
+    int nodes = 1 << n;
+
+    dimension = n;
+    if (transport->create(n) == -1)
+    {
+        result.skipped = 1;
+        return result;
+    }
+
+    run = mmap(NULL, runSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (run == MAP_FAILED)
+    {
+        perror("mmap");
+        exit(EXIT_FAILURE);
+    }
+
+    double cpuBefore = cpuMs(transport->threaded ? RUSAGE_SELF : RUSAGE_CHILDREN);
+
+    if (transport->threaded)
+    {
+        pthread_t *threads = malloc(nodes * sizeof(pthread_t));
+        pthread_attr_t attributes;
+
+        if (threads == NULL)
+        {
+            perror("malloc");
+            exit(EXIT_FAILURE);
+        }
+
+        pthread_attr_init(&attributes);
+        pthread_attr_setstacksize(&attributes, 64 * 1024);
+        for (int id = 0; id < nodes; id++)
+        {
+            if (pthread_create(&threads[id], &attributes, nodeThread, (void *)(intptr_t)id) != 0)
+            {
+                perror("pthread_create");
+                exit(EXIT_FAILURE);
+            }
+        }
+        for (int id = 0; id < nodes; id++)
+            pthread_join(threads[id], NULL);
+        pthread_attr_destroy(&attributes);
+        free(threads);
+    }
+    else
+    {
+        fflush(NULL); // The children would print what is still buffered
+        for (int id = 0; id < nodes; id++)
+        {
+            pid_t pid = fork();
+
+            if (pid == -1)
+            {
+                perror("fork");
+                exit(EXIT_FAILURE);
+            }
+            if (pid == 0)
+            {
+                if (transport->wire != NULL)
+                    transport->wire(id, n);
+                nodeLoop(id);
+                exit(0);
+            }
+        }
+        while (wait(NULL) > 0)
+            ;
+    }
+
+    result.cpuMs = cpuMs(transport->threaded ? RUSAGE_SELF : RUSAGE_CHILDREN) - cpuBefore;
+    transport->destroy(n);
+
+    result.hops = run->hops;
+    double seconds = (run->endNs - run->startNs) / 1e9;
+    result.hopsPerSecond = seconds > 0 ? run->hops / seconds : 0;
+
+    qsort(run->latencyNs, run->hops, sizeof(uint64_t), compareLatency);
+    result.p50 = run->latencyNs[run->hops / 2] / 1e3;
+    result.p90 = run->latencyNs[(int)(run->hops * 0.9)] / 1e3;
+    result.p99 = run->latencyNs[(int)(run->hops * 0.99)] / 1e3;
+    result.max = run->latencyNs[run->hops - 1] / 1e3;
+
+    munmap(run, runSize);
+    return result;
+}
+
+
+static void usage(char *name)
+{
+    printf("Usage: %s [options] [transport...]\n", name);
+    printf("  -n, --max-dimension <n>   run the cubes of dimension 1 to n (default: 12)\n");
+    printf("  -H, --hops <count>        hops of the token in each run (default: 20000)\n");
+    printf("  -d, --duration <seconds>  end a run after this time if the hops are not done (default: 1)\n");
+    printf("  -o, --output <file>       results table (default: transports.tsv)\n");
+    printf("transports: pipe-poll, socketpair, shm, eventfd, futex, thread (default: all)\n");
+}
+
+
+/**
+ * Compares the transports on every dimension up to --max-dimension.
+ *
+ * Each run walks a single token, so every hop latency is a full send, wake-up and
+ * receive. The results are printed as they come and written to a tab-separated
+ * table, then the fastest transport of each dimension is printed, by median hop
+ * latency.
+ */
+int main(int argc, char *argv[])
+{
+    static struct option longOptions[] = {
+        {"max-dimension", required_argument, NULL, 'n'},
+        {"hops", required_argument, NULL, 'H'},
+        {"duration", required_argument, NULL, 'd'},
+        {"output", required_argument, NULL, 'o'},
+        {NULL, 0, NULL, 0}
+    };
+    int maxDimension = 12;
+    const char *output = "transports.tsv";
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "n:H:d:o:", longOptions, NULL)) != -1) {
+        switch (opt) {
+        case 'n':
+            maxDimension = atoi(optarg);
+            break;
+        case 'H':
+            maxHops = atoi(optarg);
+            break;
+        case 'd':
+            maxDurationNs = (uint64_t)(atof(optarg) * 1e9);
+            break;
+        case 'o':
+            output = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (maxDimension < 1 || maxDimension > MAX_DIMENSION || maxHops < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    const struct transport *selected[16];
+    int nbSelected = 0;
+    for (int i = optind; i < argc && nbSelected < 16; i++) {
+        if ((selected[nbSelected++] = findTransport(argv[i])) == NULL) {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (nbSelected == 0)
+        for (int t = 0; t < nbTransports && t < 16; t++)
+            selected[nbSelected++] = &transports[t];
+
+    // Pipes and socketpairs need n * 2^n descriptors
+    struct rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+
+    signal(SIGPIPE, SIG_IGN);
+
+    FILE *table = fopen(output, "w");
+    if (table == NULL)
+    {
+        perror("fopen");
+        exit(EXIT_FAILURE);
+    }
+    fprintf(table, "n\ttransport\thops\thops_per_s\tp50_us\tp90_us\tp99_us\tmax_us\tcpu_ms\tcpu_us_per_hop\n");
+
+    for (int n = 1; n <= maxDimension; n++)
+    {
+        const char *best = NULL;
+        double bestP50 = 0;
+
+        for (int t = 0; t < nbSelected; t++)
+        {
+            transport = selected[t];
+            struct benchResult result = runTransport(n);
+
+            if (result.skipped)
+            {
+                printf("transport n=%d backend=%s skipped: %s\n", n, transport->name, strerror(errno));
+                fprintf(table, "%d\t%s\t-\t-\t-\t-\t-\t-\t-\t-\n", n, transport->name);
+                fflush(table);
+                continue;
+            }
+
+            printf("transport n=%d backend=%s hops=%d hops_per_s=%.0f p50_us=%.2f p90_us=%.2f p99_us=%.2f max_us=%.2f cpu_ms=%.1f cpu_us_per_hop=%.2f\n",
+                   n, transport->name, result.hops, result.hopsPerSecond, result.p50, result.p90, result.p99, result.max,
+                   result.cpuMs, result.cpuMs * 1e3 / result.hops);
+            fprintf(table, "%d\t%s\t%d\t%.0f\t%.2f\t%.2f\t%.2f\t%.2f\t%.1f\t%.2f\n",
+                    n, transport->name, result.hops, result.hopsPerSecond, result.p50, result.p90, result.p99, result.max,
+                    result.cpuMs, result.cpuMs * 1e3 / result.hops);
+            fflush(table);
+
+            if (best == NULL || result.p50 < bestP50)
+            {
+                best = transport->name;
+                bestP50 = result.p50;
+            }
+        }
+
+        if (best != NULL)
+            printf("best n=%d backend=%s p50_us=%.2f\n", n, best, bestP50);
+    }
+
+    fclose(table);
+    return 0;
+}
@@ -0,0 +1,222 @@
+#include "walksim.h"
+#include <sys/stat.h>
+
+#define LANES 8 // walkers advanced together by one vector operation
+#define NEVER UINT64_MAX
+
+typedef uint32_t v8su __attribute__((vector_size(LANES * sizeof(uint32_t))));
+
+
+/**
+ * Per-node arrival statistics, comparable with the files written by passToken().
+ * Only kept when the cube is small enough for one entry per node.
+ */
+struct arrivals {
+    uint64_t *last;  // step of the last arrival of any walker, NEVER if not visited yet
+    uint64_t *sum;   // sum of the steps between consecutive arrivals
+    uint32_t *count; // number of arrivals
+};
+
+
+/**
+ * Counts the visited nodes of the cube with popcount over the visited bitset.
+ */
+static uint64_t countVisited(const uint64_t *visited, uint64_t words)
+{
+    uint64_t count = 0;
+    for (uint64_t w = 0; w < words; w++)
+        count += __builtin_popcountll(visited[w]);
+    return count;
+}
+
+
+/**
+ * Writes one line per node with its visits and mean time between arrivals.
+ * 
+ * The file goes in the same directory as the files written by passToken() for
+ * the same dimension.
+ */
+static void writeArrivals(int n, const struct arrivals *arrivals)
+{
+    char filename[128];
+    sprintf(filename, "%d", n);
+    mkdir(filename, S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH);
+    sprintf(filename, "%d/walksim.txt", n);
+
+    FILE *file = fopen(filename, "w");
+    if (file == NULL)
+    {
+        perror("fopen");
+        return;
+    }
+
+    for (int node = 0; node < (1<<n); node++)
+    {
+        char *binaryString = intToBinary(node, n);
+        uint32_t returns = arrivals->count[node] > 1 ? arrivals->count[node] - 1 : 0;
+        fprintf(file, "%s visits: %u, mean return hops: %.1f\n", binaryString, arrivals->count[node],
+                returns ? (double)arrivals->sum[node] / returns : 0.0);
+        free(binaryString);
+    }
+
+    fclose(file);
+}
+
+
+/**
+ * Simulates many independent random walkers on the implicit hypercube in one process.
+ * 
+ * This is the counterpart of the forked passToken() walk for dimensions where 2^n
+ * processes are out of reach. All walkers start on node 0 and, at each step, every
+ * walker flips one random bit of its position. Walkers are advanced LANES at a time
+ * with GCC vector extensions: one xorshift32 state per walker, and the dimension is
+ * taken from the high 16 bits of the random value with a multiply and a shift
+ * instead of a modulo.
+ * 
+ * Visited nodes are tracked in a bitset of 2^n bits. The number of visited nodes is
+ * updated when a bit is set for the first time and checked with popcount at
+ * logarithmically spaced steps to report the coverage curve. For n <= MAX_DIMENSION
+ * the arrivals at each node are also recorded and written to n/walksim.txt, so a
+ * run with a single walker can be compared with the token files of the forked
+ * implementation (the token value is the hop count of the walk).
+ * 
+ * param n The dimension of the hypercube.
+ * param walkers The number of walkers. The last vector is padded with walkers that
+ *                move but are not counted.
+ * param steps The number of steps to simulate, 0 to stop when every node is visited.
+ */
+void simulateWalkers(int n, int walkers, uint64_t steps)
+{
+    uint64_t nodes = (uint64_t)1 << n;
+    uint64_t words = (nodes + 63) / 64;
+    int groups = (walkers + LANES - 1) / LANES;
+
+    v8su *position = aligned_alloc(sizeof(v8su), groups * sizeof(v8su));
+    v8su *state = aligned_alloc(sizeof(v8su), groups * sizeof(v8su));
+    uint64_t *visited = calloc(words, sizeof(uint64_t));
+    if (position == NULL || state == NULL || visited == NULL)
+    {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    struct arrivals arrivals = {0};
+    if (n <= MAX_DIMENSION)
+    {
+        arrivals.last = malloc(nodes * sizeof(uint64_t));
+        arrivals.sum = calloc(nodes, sizeof(uint64_t));
+        arrivals.count = calloc(nodes, sizeof(uint32_t));
+        if (arrivals.last == NULL || arrivals.sum == NULL || arrivals.count == NULL)
+        {
+            perror("malloc");
+            exit(EXIT_FAILURE);
+        }
+        for (uint64_t p = 0; p < nodes; p++)
+            arrivals.last[p] = NEVER;
+        arrivals.last[0] = 0; // every walker starts on node 0, like the token
+        arrivals.count[0] = 1;
+    }
+
+    uint32_t seed = (uint32_t)time(NULL) | 1;
+    for (int g = 0; g < groups; g++)
+    {
+        for (int l = 0; l < LANES; l++)
+        {
+            position[g][l] = 0;
+            seed = seed * 1664525u + 1013904223u;
+            state[g][l] = seed | 1;
+        }
+    }
+
+    visited[0] = 1;
+    uint64_t covered = 1, coverSteps = 0, checkpoint = 1;
+    uint64_t step = 0;
+    uint64_t start = monotonicNs();
+
+    while (steps ? step < steps : covered < nodes)
+    {
+        step++;
+
+        for (int g = 0; g < groups; g++)
+        {
+            v8su x = state[g];
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            state[g] = x;
+
+            v8su dim = ((x >> 16) * (uint32_t)n) >> 16;
+            v8su pos = position[g] ^ ((v8su){1, 1, 1, 1, 1, 1, 1, 1} << dim);
+            position[g] = pos;
+
+            int active = walkers - g * LANES < LANES ? walkers - g * LANES : LANES;
+            for (int l = 0; l < active; l++)
+            {
+                uint32_t p = pos[l];
+                uint64_t bit = 1ULL << (p & 63);
+
+                if (!(visited[p >> 6] & bit))
+                {
+                    visited[p >> 6] |= bit;
+                    covered++;
+                }
+
+                if (arrivals.count != NULL)
+                {
+                    if (arrivals.last[p] != NEVER)
+                        arrivals.sum[p] += step - arrivals.last[p];
+                    arrivals.last[p] = step;
+                    arrivals.count[p]++;
+                }
+            }
+        }
+
+        if (covered == nodes && coverSteps == 0)
+            coverSteps = step;
+
+        if (step == checkpoint)
+        {
+            printf("walk step=%llu coverage=%.6f\n", (unsigned long long)step,
+                   (double)countVisited(visited, words) / nodes);
+            checkpoint *= 2;
+        }
+    }
+
+    uint64_t elapsed = monotonicNs() - start;
+    uint64_t visitedNodes = countVisited(visited, words);
+    double seconds = elapsed / 1e9;
+
+    printf("walk n=%d walkers=%d steps=%llu coverage=%.6f cover_steps=%llu cover_hops=%llu walker_steps_per_s=%.0f\n",
+           n, walkers, (unsigned long long)step, (double)visitedNodes / nodes,
+           (unsigned long long)coverSteps, (unsigned long long)coverSteps * walkers,
+           seconds > 0 ? (double)step * walkers / seconds : 0);
+
+    if (arrivals.count != NULL)
+    {
+        uint64_t returns = 0, sum = 0;
+        uint32_t minVisits = UINT32_MAX, maxVisits = 0;
+        for (uint64_t p = 0; p < nodes; p++)
+        {
+            if (arrivals.count[p] > 1)
+            {
+                returns += arrivals.count[p] - 1;
+                sum += arrivals.sum[p];
+            }
+            if (arrivals.count[p] < minVisits)
+                minVisits = arrivals.count[p];
+            if (arrivals.count[p] > maxVisits)
+                maxVisits = arrivals.count[p];
+        }
+        printf("walk n=%d mean_return_steps=%.1f expected=%.1f visits_min=%u visits_max=%u\n",
+               n, returns ? (double)sum / returns : 0.0, (double)nodes / walkers, minVisits, maxVisits);
+
+        writeArrivals(n, &arrivals);
+        free(arrivals.last);
+        free(arrivals.sum);
+        free(arrivals.count);
+    }
+
+    free(position);
+    free(state);
+    free(visited);
+}
@@ -0,0 +1,10 @@
+#ifndef WALKSIM_H
+#define WALKSIM_H
+
+#include "hypercube.h"
+
+#define MAX_SIMULATED_DIMENSION 30 // largest cube the in-process simulator accepts
+
+void simulateWalkers(int n, int walkers, uint64_t steps);
+
+#endif //WALKSIM_H
@@ -0,0 +1,846 @@
+#include "workloads.h"
+#include "collectives.h"
+#include <math.h>
+
+
+/**
+ * Advance a xorshift32 generator and return its next value.
+ * 
+ * Every node owns its own state, so the generated data does not depend on the
+ * scheduling of the other processes.
+ * 
+ * param state The generator state, must not be 0
+ * return uint32_t The next pseudo-random value
+ */
+uint32_t xorshift32(uint32_t *state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+
+/**
+ * Sorts an array of keys in ascending order with a least significant digit radix sort.
+ * 
+ * Four passes over 8-bit digits, each one a counting sort from one buffer to the
+ * other. After an even number of passes the result is back in keys.
+ * 
+ * param keys The keys to sort
+ * param tmp A scratch buffer of the same size
+ * param count The number of keys
+ */
+void radixSort(uint32_t *keys, uint32_t *tmp, int count)
+{
+    uint32_t *src = keys, *dst = tmp;
+
+    for (int shift = 0; shift < 32; shift += 8)
+    {
+        int offsets[256] = {0};
+
+        for (int i = 0; i < count; i++)
+            offsets[(src[i] >> shift) & 0xff]++;
+
+        int sum = 0;
+        for (int d = 0; d < 256; d++)
+        {
+            int c = offsets[d];
+            offsets[d] = sum;
+            sum += c;
+        }
+
+        for (int i = 0; i < count; i++)
+            dst[offsets[(src[i] >> shift) & 0xff]++] = src[i];
+
+        uint32_t *swap = src;
+        src = dst;
+        dst = swap;
+    }
+}
+
+
+/**
+ * Merge-split step of the block bitonic sort.
+ * 
+ * Both blocks are sorted in ascending order. The node keeping the low half takes the
+ * count smallest keys of the two blocks, the other one the count largest, so both
+ * output blocks stay sorted.
+ * 
+ * param mine The keys of this node
+ * param theirs The keys received from the neighbour
+ * param out The buffer receiving the kept half
+ * param count The number of keys in each block
+ * param keepLow 1 to keep the smallest keys, 0 to keep the largest
+ */
+static void mergeSplit(const uint32_t *mine, const uint32_t *theirs, uint32_t *out, int count, int keepLow)
+{
+    if (keepLow)
+    {
+        int a = 0, b = 0;
+        for (int k = 0; k < count; k++)
+            out[k] = mine[a] <= theirs[b] ? mine[a++] : theirs[b++];
+    }
+    else
+    {
+        int a = count - 1, b = count - 1;
+        for (int k = count - 1; k >= 0; k--)
+            out[k] = mine[a] >= theirs[b] ? mine[a--] : theirs[b--];
+    }
+}
+
+
+/**
+ * Sorts keys distributed over the hypercube with a block bitonic sort.
+ * 
+ * Each node generates blockSize random keys and sorts them locally with radixSort().
+ * Stage i then merges bitonic sequences of 2^(i+1) blocks: for j = i down to 0 the
+ * node exchanges its block with the neighbour across dimension j and keeps either the
+ * low or the high half. The direction of a stage depends on bit i+1 of the node id,
+ * so after the last stage the keys are sorted in ascending order of node id.
+ * 
+ * All nodes meet in a barrier once their keys are generated, so the timing does not
+ * include the fork of the other processes. The time spent and the resulting key range
+ * are stored in the shared statistics so the parent can check the order across nodes.
+ * 
+ * param id The ID of the current process.
+ * param n The dimension of the hypercube.
+ * param blockSize The number of keys held by each node.
+ */
+void bitonicSort(int id, int n, int blockSize)
+{
+    uint32_t *keys = malloc(blockSize * sizeof(uint32_t));
+    uint32_t *partner = malloc(blockSize * sizeof(uint32_t));
+    uint32_t *tmp = malloc(blockSize * sizeof(uint32_t));
+    if (keys == NULL || partner == NULL || tmp == NULL)
+    {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    uint32_t seed = (uint32_t)(time(NULL) ^ (id * 2654435761u)) | 1;
+    for (int k = 0; k < blockSize; k++)
+        keys[k] = xorshift32(&seed);
+
+    barrier(id, n);
+    uint64_t start = monotonicNs();
+
+    radixSort(keys, tmp, blockSize);
+
+    for (int i = 0; i < n; i++)
+    {
+        for (int j = i; j >= 0; j--)
+        {
+            int keepLow = ((id >> (i + 1)) & 1) == ((id >> j) & 1);
+
+            exchangeBlock(j, keys, partner, blockSize * sizeof(uint32_t));
+            mergeSplit(keys, partner, tmp, blockSize, keepLow);
+
+            uint32_t *swap = keys;
+            keys = tmp;
+            tmp = swap;
+        }
+    }
+
+    nodeStats[id].elapsedNs = monotonicNs() - start;
+    nodeStats[id].items = blockSize;
+    nodeStats[id].minKey = keys[0];
+    nodeStats[id].maxKey = keys[blockSize - 1];
+    nodeStats[id].sorted = 1;
+    for (int k = 1; k < blockSize; k++)
+    {
+        if (keys[k - 1] > keys[k])
+        {
+            nodeStats[id].sorted = 0;
+            break;
+        }
+    }
+
+    free(keys);
+    free(partner);
+    free(tmp);
+}
+
+
+/**
+ * Checks the result of a bitonic sort and prints its throughput.
+ * 
+ * The sort is correct if every block is sorted and the largest key of each node is
+ * not greater than the smallest key of the next one. The throughput is computed
+ * from the slowest node, which is when the whole cube is sorted.
+ * 
+ * param n The dimension of the hypercube.
+ * param blockSize The number of keys held by each node.
+ */
+void reportBitonicSort(int n, int blockSize)
+{
+    int nodes = 1<<n;
+    int ok = 1;
+    uint64_t slowest = 0;
+
+    for (int i = 0; i < nodes; i++)
+    {
+        if (!nodeStats[i].sorted || (i > 0 && nodeStats[i - 1].maxKey > nodeStats[i].minKey))
+            ok = 0;
+        if (nodeStats[i].elapsedNs > slowest)
+            slowest = nodeStats[i].elapsedNs;
+    }
+
+    double keys = (double)nodes * blockSize;
+    double seconds = slowest / 1e9;
+    printf("sort n=%d block=%d keys=%.0f time_ms=%.3f keys_per_s=%.0f %s\n",
+           n, blockSize, keys, seconds * 1e3, seconds > 0 ? keys / seconds : 0, ok ? "sorted" : "NOT SORTED");
+}
+
+
+/**
+ * Value of element k of the block sent by node src to node dst in the all-to-all benchmark.
+ */
+static uint32_t allToAllValue(int src, int dst, int k)
+{
+    return (uint32_t)src * 2654435761u ^ (uint32_t)dst * 40503u ^ (uint32_t)k;
+}
+
+
+/**
+ * Runs one all-to-all personalized exchange and checks what the node received.
+ * 
+ * Every node sends a distinct block of blockSize integers to every node, itself
+ * included. The time of each round and the number of bytes the node put on its
+ * links are stored in the shared statistics.
+ * 
+ * param id The ID of the current process.
+ * param n The dimension of the hypercube.
+ * param blockSize The number of integers in each block.
+ */
+void allToAllBenchmark(int id, int n, int blockSize)
+{
+    int nodes = 1<<n;
+    size_t blockBytes = blockSize * sizeof(uint32_t);
+    uint32_t *send = malloc(nodes * blockBytes);
+    uint32_t *recv = malloc(nodes * blockBytes);
+    if (send == NULL || recv == NULL)
+    {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int d = 0; d < nodes; d++)
+        for (int k = 0; k < blockSize; k++)
+            send[d * blockSize + k] = allToAllValue(id, d, k);
+
+    barrier(id, n);
+    uint64_t start = monotonicNs();
+    allToAll(id, n, send, recv, blockBytes, nodeStats[id].roundNs);
+    nodeStats[id].elapsedNs = monotonicNs() - start;
+    nodeStats[id].bytes = (uint64_t)n * (nodes / 2) * blockBytes;
+
+    nodeStats[id].valid = 1;
+    for (int s = 0; s < nodes && nodeStats[id].valid; s++)
+    {
+        for (int k = 0; k < blockSize; k++)
+        {
+            if (recv[s * blockSize + k] != allToAllValue(s, id, k))
+            {
+                nodeStats[id].valid = 0;
+                break;
+            }
+        }
+    }
+
+    free(send);
+    free(recv);
+}
+
+
+/**
+ * Prints the throughput and the per-round timing of an all-to-all exchange.
+ * 
+ * The payload throughput counts each personalized block once, the link throughput
+ * counts every block each time it crosses an edge. A round lasts as long as its
+ * slowest node.
+ * 
+ * param n The dimension of the hypercube.
+ * param blockSize The number of integers in each block.
+ */
+void reportAllToAll(int n, int blockSize)
+{
+    int nodes = 1<<n;
+    int ok = 1;
+    uint64_t slowest = 0;
+    double linkBytes = 0;
+
+    for (int i = 0; i < nodes; i++)
+    {
+        if (!nodeStats[i].valid)
+            ok = 0;
+        if (nodeStats[i].elapsedNs > slowest)
+            slowest = nodeStats[i].elapsedNs;
+        linkBytes += nodeStats[i].bytes;
+    }
+
+    double payload = (double)nodes * (nodes - 1) * blockSize * sizeof(uint32_t);
+    double seconds = slowest / 1e9;
+    printf("alltoall n=%d block=%d time_ms=%.3f payload_MB_per_s=%.1f link_MB_per_s=%.1f %s\n",
+           n, blockSize, seconds * 1e3,
+           seconds > 0 ? payload / seconds / 1e6 : 0,
+           seconds > 0 ? linkBytes / seconds / 1e6 : 0,
+           ok ? "valid" : "INVALID");
+
+    for (int d = 0; d < n; d++)
+    {
+        uint64_t max = 0, sum = 0;
+        for (int i = 0; i < nodes; i++)
+        {
+            sum += nodeStats[i].roundNs[d];
+            if (nodeStats[i].roundNs[d] > max)
+                max = nodeStats[i].roundNs[d];
+        }
+        printf("alltoall round=%d mean_us=%.1f max_us=%.1f\n", d, sum / 1e3 / nodes, max / 1e3);
+    }
+}
+
+
+/**
+ * Measures the latency of the dissemination barrier.
+ * 
+ * After a first barrier that absorbs the start-up of the other processes, the node
+ * times each of the iterations barriers with the monotonic clock. The time at which
+ * it left the last one is kept too, so the parent can measure how far apart the
+ * nodes are released.
+ * 
+ * param id The ID of the current process.
+ * param n The dimension of the hypercube.
+ * param iterations The number of timed barriers.
+ */
+void barrierBenchmark(int id, int n, int iterations)
+{
+    uint64_t min = UINT64_MAX, max = 0, last = 0;
+
+    barrier(id, n);
+
+    uint64_t start = monotonicNs();
+    for (int i = 0; i < iterations; i++)
+    {
+        uint64_t before = monotonicNs();
+        barrier(id, n);
+        last = monotonicNs();
+
+        if (last - before < min)
+            min = last - before;
+        if (last - before > max)
+            max = last - before;
+    }
+
+    nodeStats[id].elapsedNs = last - start;
+    nodeStats[id].items = iterations;
+    nodeStats[id].minNs = min;
+    nodeStats[id].maxNs = max;
+    nodeStats[id].exitNs = last;
+}
+
+
+/**
+ * Prints the latency of the dissemination barrier.
+ * 
+ * The mean latency is the total time of the slowest node divided by the number of
+ * barriers. The release skew is the spread of the times at which the nodes left the
+ * last barrier.
+ * 
+ * param n The dimension of the hypercube.
+ * param iterations The number of timed barriers.
+ */
+void reportBarrier(int n, int iterations)
+{
+    int nodes = 1<<n;
+    uint64_t slowest = 0, min = UINT64_MAX, max = 0;
+    uint64_t firstExit = UINT64_MAX, lastExit = 0;
+
+    for (int i = 0; i < nodes; i++)
+    {
+        if (nodeStats[i].elapsedNs > slowest)
+            slowest = nodeStats[i].elapsedNs;
+        if (nodeStats[i].minNs < min)
+            min = nodeStats[i].minNs;
+        if (nodeStats[i].maxNs > max)
+            max = nodeStats[i].maxNs;
+        if (nodeStats[i].exitNs < firstExit)
+            firstExit = nodeStats[i].exitNs;
+        if (nodeStats[i].exitNs > lastExit)
+            lastExit = nodeStats[i].exitNs;
+    }
+
+    printf("barrier n=%d iterations=%d mean_us=%.2f min_us=%.2f max_us=%.2f release_skew_us=%.2f\n",
+           n, iterations, slowest / 1e3 / iterations, min / 1e3, max / 1e3, (lastExit - firstExit) / 1e3);
+}
+
+
+/**
+ * Scatters distinct blocks from the root, then gathers a block from every node back.
+ * 
+ * Both phases start after a barrier. Each node records when it entered and left the
+ * phase, the data scattered is checked by every node and the data gathered by the root.
+ * 
+ * param id The ID of the current process.
+ * param n The dimension of the hypercube.
+ * param blockSize The number of integers in each block.
+ * param root The node scattering and gathering the blocks.
+ */
+void gatherScatterBenchmark(int id, int n, int blockSize, int root)
+{
+    int nodes = 1<<n;
+    size_t blockBytes = blockSize * sizeof(uint32_t);
+    uint32_t *block = malloc(blockBytes);
+    uint32_t *all = id == root ? malloc(nodes * blockBytes) : NULL;
+    if (block == NULL || (id == root && all == NULL))
+    {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    if (id == root)
+        for (int d = 0; d < nodes; d++)
+            for (int k = 0; k < blockSize; k++)
+                all[d * blockSize + k] = allToAllValue(root, d, k);
+
+    barrier(id, n);
+    nodeStats[id].scatterStartNs = monotonicNs();
+    scatter(id, n, root, all, block, blockBytes);
+    nodeStats[id].scatterEndNs = monotonicNs();
+
+    nodeStats[id].valid = 1;
+    for (int k = 0; k < blockSize; k++)
+    {
+        if (block[k] != allToAllValue(root, id, k))
+        {
+            nodeStats[id].valid = 0;
+            break;
+        }
+        block[k] = allToAllValue(id, root, k);
+    }
+
+    barrier(id, n);
+    nodeStats[id].gatherStartNs = monotonicNs();
+    gather(id, n, root, block, all, blockBytes);
+    nodeStats[id].gatherEndNs = monotonicNs();
+
+    if (id == root)
+    {
+        for (int s = 0; s < nodes; s++)
+            for (int k = 0; k < blockSize; k++)
+                if (all[s * blockSize + k] != allToAllValue(s, root, k))
+                    nodeStats[id].valid = 0;
+        free(all);
+    }
+
+    free(block);
+}
+
+
+/**
+ * Prints the duration and throughput of the scatter and gather phases.
+ * 
+ * A phase lasts from the first node entering it to the last node leaving it.
+ * 
+ * param n The dimension of the hypercube.
+ * param blockSize The number of integers in each block.
+ * param root The node that scattered and gathered the blocks.
+ */
+void reportGatherScatter(int n, int blockSize, int root)
+{
+    int nodes = 1<<n;
+    int ok = 1;
+    uint64_t scatterStart = UINT64_MAX, scatterEnd = 0, gatherStart = UINT64_MAX, gatherEnd = 0;
+
+    for (int i = 0; i < nodes; i++)
+    {
+        if (!nodeStats[i].valid)
+            ok = 0;
+        if (nodeStats[i].scatterStartNs < scatterStart)
+            scatterStart = nodeStats[i].scatterStartNs;
+        if (nodeStats[i].scatterEndNs > scatterEnd)
+            scatterEnd = nodeStats[i].scatterEndNs;
+        if (nodeStats[i].gatherStartNs < gatherStart)
+            gatherStart = nodeStats[i].gatherStartNs;
+        if (nodeStats[i].gatherEndNs > gatherEnd)
+            gatherEnd = nodeStats[i].gatherEndNs;
+    }
+
+    double bytes = (double)(nodes - 1) * blockSize * sizeof(uint32_t);
+    double scatterSeconds = (scatterEnd - scatterStart) / 1e9;
+    double gatherSeconds = (gatherEnd - gatherStart) / 1e9;
+    printf("scatter n=%d root=%d block=%d steps=%d time_ms=%.3f MB_per_s=%.1f\n",
+           n, root, blockSize, n, scatterSeconds * 1e3, scatterSeconds > 0 ? bytes / scatterSeconds / 1e6 : 0);
+    printf("gather n=%d root=%d block=%d steps=%d time_ms=%.3f MB_per_s=%.1f %s\n",
+           n, root, blockSize, n, gatherSeconds * 1e3, gatherSeconds > 0 ? bytes / gatherSeconds / 1e6 : 0,
+           ok ? "valid" : "INVALID");
+}
+
+
+typedef double v4df __attribute__((vector_size(4 * sizeof(double))));
+
+
+/**
+ * Decimation in frequency butterflies between two halves of a span.
+ * 
+ * For j < h: a[j] = a[j] + b[j] and b[j] = (a[j] - b[j]) * w[j], on complex numbers
+ * stored as separate real and imaginary arrays. Four butterflies are computed at a
+ * time with GCC vector extensions, the remainder one by one.
+ */
+static void butterflies(double *restrict aRe, double *restrict aIm, double *restrict bRe, double *restrict bIm,
+                        const double *restrict wRe, const double *restrict wIm, int h)
+{
+    int j = 0;
+
+    for (; j + 4 <= h; j += 4)
+    {
+        v4df ar, ai, br, bi, wr, wi;
+        memcpy(&ar, aRe + j, sizeof(ar));
+        memcpy(&ai, aIm + j, sizeof(ai));
+        memcpy(&br, bRe + j, sizeof(br));
+        memcpy(&bi, bIm + j, sizeof(bi));
+        memcpy(&wr, wRe + j, sizeof(wr));
+        memcpy(&wi, wIm + j, sizeof(wi));
+
+        v4df dr = ar - br, di = ai - bi;
+        ar += br;
+        ai += bi;
+        br = dr * wr - di * wi;
+        bi = dr * wi + di * wr;
+
+        memcpy(aRe + j, &ar, sizeof(ar));
+        memcpy(aIm + j, &ai, sizeof(ai));
+        memcpy(bRe + j, &br, sizeof(br));
+        memcpy(bIm + j, &bi, sizeof(bi));
+    }
+
+    for (; j < h; j++)
+    {
+        double dr = aRe[j] - bRe[j], di = aIm[j] - bIm[j];
+        aRe[j] += bRe[j];
+        aIm[j] += bIm[j];
+        bRe[j] = dr * wRe[j] - di * wIm[j];
+        bIm[j] = dr * wIm[j] + di * wRe[j];
+    }
+}
+
+
+/**
+ * Reverse the lowest bits of an integer.
+ */
+static uint64_t reverseBits(uint64_t value, int bits)
+{
+    uint64_t reversed = 0;
+    for (int b = 0; b < bits; b++)
+    {
+        reversed = (reversed << 1) | (value & 1);
+        value >>= 1;
+    }
+    return reversed;
+}
+
+
+/**
+ * Test signal of the FFT benchmark: two complex tones, whose transform is known.
+ */
+static void fftSignal(uint64_t t, uint64_t size, double *re, double *im)
+{
+    double a = 2 * M_PI * (double)((3 * t) % size) / size;
+    double b = 2 * M_PI * (double)(((size / 4 + 1) * t) % size) / size;
+    *re = cos(a) + 0.5 * cos(b);
+    *im = sin(a) + 0.5 * sin(b);
+}
+
+
+/**
+ * Runs a distributed radix-2 decimation in frequency FFT over 2^n * blockSize points.
+ * 
+ * Node id owns the points id * blockSize to (id + 1) * blockSize - 1. The first n
+ * stages pair points whose global index differs in bit log2(blockSize) + d, for d from
+ * n-1 down to 0: they are computed after exchanging the whole block with the neighbour
+ * across dimension d, the node with bit d clear keeping the sums and the other one the
+ * twiddled differences. The remaining log2(blockSize) stages are local and run on the
+ * vectorised butterflies with a per-stage contiguous twiddle table. The result is left
+ * in bit-reversed order, as usual for an in-place DIF transform.
+ * 
+ * The input is a sum of two complex tones, so every node can check its part of the
+ * spectrum and store the largest error in the shared statistics.
+ * 
+ * param id The ID of the current process.
+ * param n The dimension of the hypercube.
+ * param blockSize The number of points held by each node, a power of two.
+ */
+void fftBenchmark(int id, int n, int blockSize)
+{
+    uint64_t size = (uint64_t)blockSize << n;
+    int logSize = n + __builtin_ctz(blockSize);
+    double *data = malloc(2 * blockSize * sizeof(double));
+    double *partner = malloc(2 * blockSize * sizeof(double));
+    double *twRe = malloc(blockSize * sizeof(double));
+    double *twIm = malloc(blockSize * sizeof(double));
+    if (data == NULL || partner == NULL || twRe == NULL || twIm == NULL)
+    {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    double *re = data, *im = data + blockSize;
+
+    for (int p = 0; p < blockSize; p++)
+        fftSignal((uint64_t)id * blockSize + p, size, &re[p], &im[p]);
+
+    // Twiddles of the local stage of span h are stored contiguously at [h, 2h)
+    for (int h = 1; h < blockSize; h *= 2)
+    {
+        for (int j = 0; j < h; j++)
+        {
+            twRe[h + j] = cos(-M_PI * j / h);
+            twIm[h + j] = sin(-M_PI * j / h);
+        }
+    }
+
+    barrier(id, n);
+    uint64_t start = monotonicNs();
+
+    for (int d = n - 1; d >= 0; d--)
+    {
+        uint64_t h = (uint64_t)blockSize << d;
+        int upper = (id >> d) & 1;
+
+        exchangeBlock(d, data, partner, 2 * blockSize * sizeof(double));
+
+        if (!upper)
+        {
+            for (int p = 0; p < blockSize; p++)
+            {
+                re[p] += partner[p];
+                im[p] += partner[blockSize + p];
+            }
+        }
+        else
+        {
+            for (int p = 0; p < blockSize; p++)
+            {
+                uint64_t j = ((uint64_t)id * blockSize + p) % h;
+                double wr = cos(-M_PI * j / h), wi = sin(-M_PI * j / h);
+                double dr = partner[p] - re[p], di = partner[blockSize + p] - im[p];
+                re[p] = dr * wr - di * wi;
+                im[p] = dr * wi + di * wr;
+            }
+        }
+    }
+
+    for (int h = blockSize / 2; h >= 1; h /= 2)
+        for (int base = 0; base < blockSize; base += 2 * h)
+            butterflies(re + base, im + base, re + base + h, im + base + h, twRe + h, twIm + h, h);
+
+    nodeStats[id].elapsedNs = monotonicNs() - start;
+    nodeStats[id].items = blockSize;
+    nodeStats[id].bytes = (uint64_t)n * 2 * blockSize * sizeof(double);
+
+    double maxError = 0;
+    for (int p = 0; p < blockSize; p++)
+    {
+        uint64_t k = reverseBits((uint64_t)id * blockSize + p, logSize);
+        double expectedRe = 0;
+        if (k == 3 % size)
+            expectedRe += size;
+        if (k == (size / 4 + 1) % size)
+            expectedRe += 0.5 * size;
+        double error = fabs(re[p] - expectedRe) + fabs(im[p]);
+        if (error > maxError)
+            maxError = error;
+    }
+    nodeStats[id].maxError = maxError;
+
+    free(data);
+    free(partner);
+    free(twRe);
+    free(twIm);
+}
+
+
+/**
+ * Prints the duration and throughput of the distributed FFT.
+ * 
+ * The rate uses the usual 5 N log2(N) floating point operations of a radix-2 FFT.
+ * The error is relative to the largest coefficient of the spectrum.
+ * 
+ * param n The dimension of the hypercube.
+ * param blockSize The number of points held by each node.
+ */
+void reportFft(int n, int blockSize)
+{
+    int nodes = 1<<n;
+    uint64_t slowest = 0;
+    double linkBytes = 0, maxError = 0;
+
+    for (int i = 0; i < nodes; i++)
+    {
+        if (nodeStats[i].elapsedNs > slowest)
+            slowest = nodeStats[i].elapsedNs;
+        if (nodeStats[i].maxError > maxError)
+            maxError = nodeStats[i].maxError;
+        linkBytes += nodeStats[i].bytes;
+    }
+
+    double size = (double)nodes * blockSize;
+    double seconds = slowest / 1e9;
+    double flops = 5 * size * log2(size);
+    printf("fft n=%d block=%d points=%.0f time_ms=%.3f MFLOP_per_s=%.1f link_MB_per_s=%.1f rel_error=%.2e %s\n",
+           n, blockSize, size, seconds * 1e3,
+           seconds > 0 ? flops / seconds / 1e6 : 0,
+           seconds > 0 ? linkBytes / seconds / 1e6 : 0,
+           maxError / size, maxError / size < 1e-9 ? "valid" : "INVALID");
+}
+
+
+/**
+ * The node side of the start-up benchmark: node 0 sends a token to node 1, which records
+ * when it arrives, and every node leaves as soon as it is wired.
+ * 
+ * param id The ID of the current process.
+ * param n The dimension of the hypercube.
+ */
+void startupBenchmark(int id, int n)
+{
+    int token = 1;
+    (void)n;
+
+    if (id == 0)
+    {
+        if (write(connectedPipes[1], &token, sizeof(token)) == -1)
+        {
+            perror("write failed");
+            exit(EXIT_FAILURE);
+        }
+    }
+    else if (id == 1)
+    {
+        if (read(connectedPipes[0], &token, sizeof(token)) != sizeof(token))
+        {
+            perror("pipe read fail");
+            exit(EXIT_FAILURE);
+        }
+        nodeStats[id].firstHopNs = monotonicNs();
+        nodeStats[id].items = 1;
+    }
+}
+
+
+/**
+ * Moves large payloads along every edge of a dimension, with write() then with vmsplice().
+ * 
+ * For each dimension in turn, the node whose bit is clear sends BANDWIDTH_VOLUME bytes to
+ * its neighbour in messages of payload bytes, first with sendBlock() and then with
+ * spliceBlock(), and the neighbour receives them with receiveBlock(). All the edges of the
+ * dimension run at once, after a barrier, and the receiver times each phase up to its
+ * last byte. The payload is a fixed pattern the receiver checks on one word per page;
+ * the pipes are grown to the payload size first.
+ * 
+ * param id The ID of the current process.
+ * param n The dimension of the hypercube.
+ * param payload The size of a message in bytes.
+ */
+void bandwidthBenchmark(int id, int n, int payload)
+{
+    long page = sysconf(_SC_PAGESIZE);
+    int messages = BANDWIDTH_VOLUME / payload > 0 ? BANDWIDTH_VOLUME / payload : 1;
+    uint32_t *buffer;
+
+    if (posix_memalign((void **)&buffer, page, payload) != 0)
+    {
+        perror("posix_memalign");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t k = 0; k < payload / sizeof(uint32_t); k++)
+        buffer[k] = (uint32_t)k * 2654435761u;
+
+    nodeStats[id].valid = 1;
+    for (int d = 0; d < n; d++)
+    {
+        int sender = !(id & (1 << d));
+
+        if (sender)
+            growPipe(d, payload);
+
+        for (int splice = 0; splice <= 1; splice++)
+        {
+            barrier(id, n);
+            uint64_t start = monotonicNs();
+
+            for (int m = 0; m < messages; m++)
+            {
+                if (!sender)
+                    receiveBlock(d, buffer, payload);
+                else if (splice)
+                    spliceBlock(d, buffer, payload);
+                else
+                    sendBlock(d, buffer, payload);
+            }
+
+            if (sender)
+                continue;
+            if (splice)
+                nodeStats[id].splicedNs[d] = monotonicNs() - start;
+            else
+                nodeStats[id].roundNs[d] = monotonicNs() - start;
+            for (size_t k = 0; k < payload / sizeof(uint32_t); k += page / sizeof(uint32_t))
+                if (buffer[k] != (uint32_t)k * 2654435761u)
+                    nodeStats[id].valid = 0;
+        }
+        if (!sender)
+            nodeStats[id].bytes += 2 * (uint64_t)messages * payload;
+    }
+
+    free(buffer);
+}
+
+
+/**
+ * Prints the bandwidth of each dimension with write() and with vmsplice().
+ * 
+ * link_GB_per_s is the mean rate of one edge, total_GB_per_s what all the edges of the
+ * dimension moved together, up to the slowest of them.
+ * 
+ * param n The dimension of the hypercube.
+ * param payload The size of a message in bytes.
+ */
+void reportBandwidth(int n, int payload)
+{
+    int nodes = 1<<n;
+    int ok = 1;
+    int messages = BANDWIDTH_VOLUME / payload > 0 ? BANDWIDTH_VOLUME / payload : 1;
+    double volume = (double)messages * payload;
+
+    for (int i = 0; i < nodes; i++)
+        if (!nodeStats[i].valid)
+            ok = 0;
+
+    printf("bandwidth n=%d payload_KiB=%d messages=%d %s\n", n, payload / 1024, messages, ok ? "valid" : "INVALID");
+    for (int d = 0; d < n; d++)
+    {
+        double linkRate[2] = { 0, 0 };
+        uint64_t slowest[2] = { 0, 0 };
+
+        for (int i = 0; i < nodes; i++)
+        {
+            if (!(i & (1 << d)))
+                continue; // the receivers timed the transfers
+            uint64_t ns[2] = { nodeStats[i].roundNs[d], nodeStats[i].splicedNs[d] };
+            for (int mode = 0; mode < 2; mode++)
+            {
+                linkRate[mode] += ns[mode] > 0 ? volume / ns[mode] : 0;
+                if (ns[mode] > slowest[mode])
+                    slowest[mode] = ns[mode];
+            }
+        }
+
+        double copyTotal = slowest[0] > 0 ? volume * (nodes / 2) / slowest[0] : 0;
+        double spliceTotal = slowest[1] > 0 ? volume * (nodes / 2) / slowest[1] : 0;
+        printf("bandwidth dim=%d copy_link_GB_per_s=%.2f copy_total_GB_per_s=%.2f splice_link_GB_per_s=%.2f splice_total_GB_per_s=%.2f speedup=%.2f\n",
+               d, linkRate[0] / (nodes / 2), copyTotal, linkRate[1] / (nodes / 2), spliceTotal,
+               copyTotal > 0 ? spliceTotal / copyTotal : 0);
+    }
+}
@@ -0,0 +1,36 @@
+#ifndef WORKLOADS_H
+#define WORKLOADS_H
+
+#include "hypercube.h"
+
+uint32_t xorshift32(uint32_t *state);
+
+void radixSort(uint32_t *keys, uint32_t *tmp, int count);
+
+void bitonicSort(int id, int n, int blockSize);
+
+void reportBitonicSort(int n, int blockSize);
+
+void allToAllBenchmark(int id, int n, int blockSize);
+
+void reportAllToAll(int n, int blockSize);
+
+void barrierBenchmark(int id, int n, int iterations);
+
+void reportBarrier(int n, int iterations);
+
+void gatherScatterBenchmark(int id, int n, int blockSize, int root);
+
+void reportGatherScatter(int n, int blockSize, int root);
+
+void fftBenchmark(int id, int n, int blockSize);
+
+void reportFft(int n, int blockSize);
+
+void startupBenchmark(int id, int n);
+
+void bandwidthBenchmark(int id, int n, int payload);
+
+void reportBandwidth(int n, int payload);
+
+#endif //WORKLOADS_H